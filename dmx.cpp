@@ -80,7 +80,22 @@ int main( int argc, char const ** argv ) {
   //d->cluster_test();
   //d->test_consensus();
 
-  d->initFastq( 2, options.chunkSize, options.trimSize );
+  d->initFastq( options.mismatches, options.chunkSize, options.trimSize );
+  d->initMatcher( toCString(options.matcher), options.maxShift );
+  d->initGrouping( toCString(options.grouping) );
+  d->initStorage( options.compact );
+  d->initClustering( toCString(options.cluster), options.kmer );
+  d->initConsensus( toCString(options.consensus), options.qualityVotes );
+  d->initOutput( toCString(options.compress) );
+  d->initPipeline( options.threads, options.maxInflightChunks, options.memoryBudget );
+
+  std::string outputPrefix(toCString(options.outputPrefix));
+  if ( options.stream ) {
+    d->initStream( outputPrefix );
+  }
+  d->initSpill( options.spill, outputPrefix );
+
+  tbb::task_scheduler_init init( options.threads > 0 ? options.threads : (int) tbb::task_scheduler_init::automatic );
   d->runFastq( toCString(options.inputFiles[0]), toCString(options.inputFiles[1]) );
   
   //d->digest(0, d->readCount);
@@ -92,12 +107,17 @@ int main( int argc, char const ** argv ) {
   //d->printUnidentifiableBarcodeResults();
   
   
-  std::string outputPrefix(toCString(options.outputPrefix));
+  if ( options.stream ) {
+    // the per-barcode files were written during digest
+    return ret;
+  }
+
   std::string goodFastaOutfile = outputPrefix+".good.fasta";
   std::string goodFastqOutfile = outputPrefix+".good.interleaved.fastq";
 
   // everything in one file
   d->printGoodFastq(goodFastqOutfile);
+  d->releaseReads();
   
   // separate files for each barcode
   //d->printPerBarcodeFasta( outputPrefix );
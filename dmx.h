@@ -64,7 +64,21 @@ struct Options
   bool pairedEnd, combinedPairs, sortedPairs;
   CharString barcodeFile;
   CharString outputPrefix;
+  CharString matcher;
+  CharString grouping;
   int chunkSize, trimSize;
+  int threads;
+  int mismatches;
+  int maxShift;
+  int maxInflightChunks, memoryBudget;
+  bool compact;
+  CharString compress;
+  bool stream;
+  int spill;
+  int kmer;
+  CharString cluster;
+  CharString consensus;
+  bool qualityVotes;
 
   String<CharString> inputFiles;
 
@@ -81,6 +95,25 @@ struct Options
     outputPrefix = oss.str();
     chunkSize = 10000;
     trimSize = 0;
+    threads = 0;
+    mismatches = 1;
+    maxShift = 2;
+    matcher = "table";
+    grouping = "sort";
+    maxInflightChunks = 0;
+    memoryBudget = 0;
+    compact = false;
+    compress = "none";
+    stream = false;
+    spill = 0;
+    kmer = 2;
+    consensus = "star";
+    qualityVotes = false;
+#ifdef DMX_HAVE_LTILIB
+    cluster = "dbscan";
+#else
+    cluster = "sketch";
+#endif
   }
 };
 
@@ -121,6 +154,21 @@ struct Options
   addOption(parser, CommandLineOption("s",  "sorted", "Paired-end reads are in sorted order.", OptionType::Boolean));
   addOption(parser, CommandLineOption("k",  "chunk", "Number of reads per chunk during parallel processing.", OptionType::Integer));
   addOption(parser, CommandLineOption("t",  "trim", "Number of bases to trim from beginning of all reads before barcode search.", OptionType::Integer));
+  addOption(parser, CommandLineOption("e",  "mismatches", "Number of mismatches (edits with the myers matcher) allowed in a barcode; at most 2 for the table matcher.", OptionType::Integer));
+  addOption(parser, CommandLineOption("a",  "matcher", "Barcode matcher: table (mismatches only) or myers (mismatches and indels).", OptionType::String, options.matcher));
+  addOption(parser, CommandLineOption("g",  "grouping", "How reads are grouped: sort (after digest) or hash (during digest).", OptionType::String, options.grouping));
+  addOption(parser, CommandLineOption("f",  "max-shift", "Largest shift, in bases, of the primer end to look for in reads whose barcode is not in place (0 disables).", OptionType::Integer));
+  addOption(parser, CommandLineOption("j",  "threads", "Number of worker threads (0 uses all cores).", OptionType::Integer));
+  addOption(parser, CommandLineOption("i",  "max-inflight-chunks", "Maximum number of chunks held in memory between reading and digest (0 picks from the thread count).", OptionType::Integer));
+  addOption(parser, CommandLineOption("m",  "memory-budget", "Approximate memory, in MB, for chunks between reading and digest (0 for no limit).", OptionType::Integer));
+  addOption(parser, CommandLineOption("z",  "compact", "Hold reads as 2-bit bases (non-ACGT written back as N) and 8-level binned qualities until output.", OptionType::Boolean));
+  addOption(parser, CommandLineOption("x",  "compress", "Compression of the output files: none, gzip (BGZF) or zstd.", OptionType::String, options.compress));
+  addOption(parser, CommandLineOption("w",  "stream", "Write each pair to a file for its barcode as it is digested, without grouping.", OptionType::Boolean));
+  addOption(parser, CommandLineOption("y",  "spill", "Memory, in MB, for reads held for grouping before they are spilled to sorted runs next to the output (0 to hold all).", OptionType::Integer));
+  addOption(parser, CommandLineOption("u",  "cluster", "How reads of a group are clustered: dbscan (needs ltilib) or sketch (MinHash, near linear).", OptionType::String, options.cluster));
+  addOption(parser, CommandLineOption("n",  "consensus", "How clusters are aligned for their consensus: star (banded, for near identical reads) or msa (seqan progressive alignment).", OptionType::String, options.consensus));
+  addOption(parser, CommandLineOption("q",  "quality-votes", "Weigh each read's vote for a consensus base by the base's quality.", OptionType::Boolean));
+  addOption(parser, CommandLineOption("l",  "kmer", "Length of the k-mers (2 to 6) whose counts dbscan clusters reads on.", OptionType::Integer, options.kmer));
   addOption(parser, CommandLineOption("o",  "outputPrefix", "Prefix for all output files.", OptionType::String, options.outputPrefix));
   addOption(parser, CommandLineOption("b",  "barcodeFile", "Mandatory barcode file.", OptionType::String | OptionType::Mandatory));
 
@@ -156,6 +204,21 @@ int parseCommandLineAndCheck(Options & options,
   getOptionValueLong(parser, "barcodeFile", options.barcodeFile);
   getOptionValueLong(parser, "chunk", options.chunkSize);
   getOptionValueLong(parser, "trim", options.trimSize);
+  getOptionValueLong(parser, "mismatches", options.mismatches);
+  getOptionValueLong(parser, "matcher", options.matcher);
+  getOptionValueLong(parser, "grouping", options.grouping);
+  getOptionValueLong(parser, "max-shift", options.maxShift);
+  getOptionValueLong(parser, "threads", options.threads);
+  getOptionValueLong(parser, "max-inflight-chunks", options.maxInflightChunks);
+  getOptionValueLong(parser, "memory-budget", options.memoryBudget);
+  getOptionValueLong(parser, "compact", options.compact);
+  getOptionValueLong(parser, "compress", options.compress);
+  getOptionValueLong(parser, "stream", options.stream);
+  getOptionValueLong(parser, "spill", options.spill);
+  getOptionValueLong(parser, "kmer", options.kmer);
+  getOptionValueLong(parser, "cluster", options.cluster);
+  getOptionValueLong(parser, "consensus", options.consensus);
+  getOptionValueLong(parser, "quality-votes", options.qualityVotes);
 
 
   options.inputFiles = getArgumentValues(parser);
@@ -173,6 +236,21 @@ int mainWithOptions(Options & options)
   std::cout << "  output prefix:   \"" << options.outputPrefix << "\"" << std::endl;
   std::cout << "  chunk size:      \"" << options.chunkSize << "\"" << std::endl;
   std::cout << "  trim size:       \"" << options.trimSize << "\"" << std::endl;
+  std::cout << "  mismatches:      \"" << options.mismatches << "\"" << std::endl;
+  std::cout << "  matcher:         \"" << options.matcher << "\"" << std::endl;
+  std::cout << "  grouping:        \"" << options.grouping << "\"" << std::endl;
+  std::cout << "  max shift:       \"" << options.maxShift << "\"" << std::endl;
+  std::cout << "  threads:         \"" << options.threads << "\"" << std::endl;
+  std::cout << "  inflight chunks: \"" << options.maxInflightChunks << "\"" << std::endl;
+  std::cout << "  memory budget:   \"" << options.memoryBudget << "\"" << std::endl;
+  std::cout << "  compact:         \"" << options.compact << "\"" << std::endl;
+  std::cout << "  compress:        \"" << options.compress << "\"" << std::endl;
+  std::cout << "  stream:          \"" << options.stream << "\"" << std::endl;
+  std::cout << "  spill:           \"" << options.spill << "\"" << std::endl;
+  std::cout << "  kmer:            \"" << options.kmer << "\"" << std::endl;
+  std::cout << "  cluster:         \"" << options.cluster << "\"" << std::endl;
+  std::cout << "  consensus:       \"" << options.consensus << "\"" << std::endl;
+  std::cout << "  quality votes:   \"" << options.qualityVotes << "\"" << std::endl;
 
   std::cout << "\nRequired Arguments:" << std::endl;
 
@@ -0,0 +1,91 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxArena.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+dmxArena::dmxArena( size_t _slabSize ) :
+  slabSize( _slabSize ), cursor( NULL ), remaining( 0 ), reserved( 0 ) { }
+
+dmxArena::dmxArena( const dmxArena & other ) :
+  slabSize( other.slabSize ), cursor( NULL ), remaining( 0 ), reserved( 0 ) { }
+
+dmxArena::~dmxArena() {
+  release();
+}
+
+void * dmxArena::allocate( size_t bytes ) {
+  bytes = ( bytes + alignment - 1 ) & ~( alignment - 1 );
+  if ( bytes > remaining ) {
+    // an oversized request gets a slab of its own, and the current slab
+    // stays open for the requests after it
+    size_t size = bytes > slabSize ? bytes : slabSize;
+    char * slab = (char *) std::malloc( size );
+    if ( slab == NULL ) {
+      std::cerr << "Out of memory allocating a " << size << " byte read slab" << std::endl;
+      std::exit( 1 );
+    }
+    slabs.push_back( slab );
+    reserved += size;
+    if ( size > slabSize ) {
+      return slab;
+    }
+    cursor = slab;
+    remaining = size;
+  }
+  void * p = cursor;
+  cursor += bytes;
+  remaining -= bytes;
+  return p;
+}
+
+char * dmxArena::copy( const char * s, size_t length ) {
+  char * p = (char *) allocate( length );
+  if ( length > 0 ) {
+    memcpy( p, s, length );
+  }
+  return p;
+}
+
+void dmxArena::release() {
+  for ( std::vector< char * >::iterator it = slabs.begin(); it != slabs.end(); ++it ) {
+    std::free( *it );
+  }
+  std::vector< char * >().swap( slabs );
+  cursor = NULL;
+  remaining = 0;
+  reserved = 0;
+}
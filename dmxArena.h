@@ -0,0 +1,79 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXARENA_H_
+#define SANDBOX_JVD_APPS_DMX_DMXARENA_H_
+
+#include <cstddef>
+#include <vector>
+
+/*
+ * Bump allocator over large slabs.  Allocations are never freed one at a
+ * time; release() hands every slab back at once, so whatever lives in an
+ * arena must not need its destructor run.  An arena belongs to one thread.
+ */
+class dmxArena {
+
+  public:
+
+    static const size_t defaultSlabSize = 1 << 20;
+    static const size_t alignment = 8;
+
+    dmxArena( size_t _slabSize = defaultSlabSize );
+    // copies start out empty; slabs are never shared
+    dmxArena( const dmxArena & other );
+    ~dmxArena();
+
+    // bytes aligned to alignment, valid until release()
+    void * allocate( size_t bytes );
+    // copies length bytes of s into the arena
+    char * copy( const char * s, size_t length );
+
+    void release();
+
+    size_t bytesReserved() { return reserved; }
+
+  private:
+
+    dmxArena & operator= ( const dmxArena & );
+
+    size_t slabSize;
+    std::vector< char * > slabs;
+    char * cursor;
+    size_t remaining;
+    size_t reserved;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXARENA_H_
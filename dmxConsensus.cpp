@@ -0,0 +1,171 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxConsensus.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+  const int unreachable = 1 << 28;
+
+  enum step { DIAGONAL, INSERTION, DELETION };
+
+  // the seed column at the middle of the band in read row i
+  inline int bandCenter( int i, int m, int n ) {
+    return m == 0 ? 0 : (int) ( ( (long) i * n + m / 2 ) / m );
+  }
+}
+
+void dmxStarAligner::alignToSeed( const std::string & read, const std::string & seed, projection & p ) const {
+  int m = read.size();
+  int n = seed.size();
+  int w = band + std::abs( n - m );
+  int width = 2 * w + 1;
+
+  // edit distance over the band; row i is read prefix i, column j - center
+  // + w is seed prefix j
+  std::vector< int > cost( ( m + 1 ) * width, unreachable );
+  std::vector< char > from( ( m + 1 ) * width, DIAGONAL );
+  for ( int i = 0; i <= m; ++i ) {
+    int c = bandCenter( i, m, n );
+    int up = bandCenter( i - 1, m, n );
+    int lo = std::max( 0, c - w );
+    int hi = std::min( n, c + w );
+    for ( int j = lo; j <= hi; ++j ) {
+      int at = i * width + j - c + w;
+      if ( i == 0 ) {
+        cost[ at ] = j;
+        from[ at ] = DELETION;
+        continue;
+      }
+      int best = unreachable;
+      char way = DIAGONAL;
+      // read base i - 1 against seed base j - 1
+      if ( j > 0 && j - 1 >= up - w && j - 1 <= up + w ) {
+        best = cost[ ( i - 1 ) * width + j - 1 - up + w ] + ( read[ i - 1 ] == seed[ j - 1 ] ? 0 : 1 );
+      }
+      // seed base j - 1 missing from the read
+      if ( j > lo && cost[ at - 1 ] + 1 < best ) {
+        best = cost[ at - 1 ] + 1;
+        way = DELETION;
+      }
+      // read base i - 1 inserted
+      if ( j >= up - w && j <= up + w && cost[ ( i - 1 ) * width + j - up + w ] + 1 < best ) {
+        best = cost[ ( i - 1 ) * width + j - up + w ] + 1;
+        way = INSERTION;
+      }
+      cost[ at ] = best;
+      from[ at ] = way;
+    }
+  }
+
+  p.columns.assign( n, -1 );
+  p.inserts.assign( n + 1, std::vector< int >() );
+  int i = m;
+  int j = n;
+  while ( i > 0 || j > 0 ) {
+    char way = from[ i * width + j - bandCenter( i, m, n ) + w ];
+    if ( i == 0 ) {
+      way = DELETION;
+    }
+    else if ( j == 0 ) {
+      way = INSERTION;
+    }
+    if ( way == DIAGONAL ) {
+      p.columns[ --j ] = --i;
+    }
+    else if ( way == DELETION ) {
+      --j;
+    }
+    else {
+      p.inserts[ j ].push_back( --i );
+    }
+  }
+  for ( size_t s = 0; s < p.inserts.size(); ++s ) {
+    std::reverse( p.inserts[ s ].begin(), p.inserts[ s ].end() );
+  }
+}
+
+void dmxStarAligner::align( const std::vector< std::string > & seqs, std::string & matrix ) const {
+  matrix.clear();
+  size_t nrow = seqs.size();
+  if ( nrow == 0 ) {
+    return;
+  }
+
+  // the seed is the read of median length
+  std::vector< std::pair< size_t, size_t > > lengths( nrow );
+  for ( size_t r = 0; r < nrow; ++r ) {
+    lengths[ r ] = std::make_pair( seqs[ r ].size(), r );
+  }
+  std::nth_element( lengths.begin(), lengths.begin() + nrow / 2, lengths.end() );
+  const std::string & seed = seqs[ lengths[ nrow / 2 ].second ];
+  size_t n = seed.size();
+
+  std::vector< projection > projections( nrow );
+  std::vector< size_t > slotWidth( n + 1, 0 );
+  for ( size_t r = 0; r < nrow; ++r ) {
+    alignToSeed( seqs[ r ], seed, projections[ r ] );
+    for ( size_t s = 0; s <= n; ++s ) {
+      slotWidth[ s ] = std::max( slotWidth[ s ], projections[ r ].inserts[ s ].size() );
+    }
+  }
+
+  // each slot's insertions, left aligned, then the seed column
+  size_t ncol = n;
+  for ( size_t s = 0; s <= n; ++s ) {
+    ncol += slotWidth[ s ];
+  }
+  matrix.assign( nrow * ncol, '-' );
+  for ( size_t r = 0; r < nrow; ++r ) {
+    const std::string & read = seqs[ r ];
+    const projection & p = projections[ r ];
+    char * row = &matrix[ r * ncol ];
+    size_t col = 0;
+    for ( size_t s = 0; s <= n; ++s ) {
+      for ( size_t k = 0; k < p.inserts[ s ].size(); ++k ) {
+        row[ col + k ] = read[ p.inserts[ s ][ k ] ];
+      }
+      col += slotWidth[ s ];
+      if ( s < n ) {
+        if ( p.columns[ s ] >= 0 ) {
+          row[ col ] = read[ p.columns[ s ] ];
+        }
+        ++col;
+      }
+    }
+  }
+}
@@ -0,0 +1,77 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXCONSENSUS_H_
+#define SANDBOX_JVD_APPS_DMX_DMXCONSENSUS_H_
+
+#include <string>
+#include <vector>
+
+/*
+ * Multiple alignment of near identical reads by banded star alignment: every
+ * read is aligned to a seed read (the one of median length) by edit distance
+ * within a band around the diagonal, and the pairwise alignments are merged
+ * on the columns of the seed, with room between them for the longest
+ * insertion any read has there.  The result has the layout of seqan's
+ * convertAlignment: one row per read, in order, of equal length, with '-'
+ * for gaps.  Cost is reads x length x band, against the progressive MSA's
+ * all-pairs distances and graph.
+ */
+class dmxStarAligner {
+
+  public:
+
+    static const unsigned defaultBand = 16;
+
+    dmxStarAligner( unsigned _band = defaultBand ) : band( _band ) { }
+
+    void align( const std::vector< std::string > & seqs, std::string & matrix ) const;
+
+  private:
+
+    // for each seed position, the read position aligned to it or -1; and
+    // for each slot before a seed position (and after the last), the read
+    // positions inserted there
+    struct projection {
+      std::vector< int > columns;
+      std::vector< std::vector< int > > inserts;
+    };
+
+    void alignToSeed( const std::string & read, const std::string & seed, projection & p ) const;
+
+    unsigned band;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXCONSENSUS_H_
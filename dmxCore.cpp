@@ -28,14 +28,33 @@
 
 #include "dmxCore.h"
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <fstream>
 #include <iostream>
 
 dmx::dmx( char* barcodeFile ) { 
-  finishedReading = false;
-  spoon = true;
+  numThreads = task_scheduler_init::automatic;
+  maxTokens = 2 * task_scheduler_init::default_num_threads();
+  chunkLimit = maxTokens + 1;
+  memoryBudget = 0;
+  matcherKind = TABLE_MATCHER;
+  groupingKind = SORT_GROUPING;
+  compactReads = false;
+  outputCompression = dmxWriter::NO_COMPRESSION;
+  streaming = false;
+  spillBytes = 0;
+  kmerLength = 2;
+  consensusKind = STAR_CONSENSUS;
+  qualityVotes = false;
+#ifdef DMX_HAVE_LTILIB
+  clusteringKind = DBSCAN_CLUSTERING;
+#else
+  clusteringKind = SKETCH_CLUSTERING;
+#endif
+  heldBytes = 0;
+  allocatedChunks = 0;
   readBarcodeFile(barcodeFile);
 }
 
@@ -43,12 +62,160 @@ void dmx::initFastq( unsigned _maxDistance, unsigned _chunkSize, unsigned _trimS
   maxDistance = _maxDistance;
   chunkSize = _chunkSize;
   trimSize = _trimSize;
+
+  // barcodes by index, as reported by the matcher
+  barcodeList.clear();
+  for ( size_t i = 0; i < barcodeNames.size(); ++i ) {
+    barcode & b = barcodes[ barcodeNames[ i ] ];
+    b.maxBarcodeDistance = maxDistance;
+    if ( b.randTagLength + b.randPrimerLength + seqTagLength > dmxReadKey::maxTagLength ) {
+      std::cerr << "Barcode " << barcodeNames[ i ] << " layout " << b.layout << " needs more than "
+        << dmxReadKey::maxTagLength << " tag bases per mate" << std::endl;
+      std::exit( 1 );
+    }
+    barcodeList.push_back( & b );
+  }
+}
+
+void dmx::initMatcher( const std::string & matcherName, unsigned maxShift ) {
+  anchor.build( barcodeList, maxShift );
+  if ( matcherName == "table" ) {
+    matcherKind = TABLE_MATCHER;
+    matcher.build( barcodeList, maxDistance );
+  }
+  else if ( matcherName == "myers" ) {
+    matcherKind = MYERS_MATCHER;
+    myersMatcher.build( barcodeList, maxDistance );
+    std::cout << "myers kernel: " << dmxMyersKernel::select().name << std::endl;
+  }
+  else {
+    std::cerr << "Unknown matcher: " << matcherName << " (expected table or myers)" << std::endl;
+    std::exit( 1 );
+  }
+}
+
+void dmx::initPipeline( int _numThreads, unsigned _maxInflightChunks, unsigned _memoryBudget ) {
+  numThreads = _numThreads > 0 ? _numThreads : (int) task_scheduler_init::automatic;
+  // enough chunks in flight to keep every worker busy while one is refilled
+  maxTokens = 2 * ( _numThreads > 0 ? _numThreads : task_scheduler_init::default_num_threads() );
+  chunkLimit = _maxInflightChunks > 0 ? _maxInflightChunks : maxTokens + 1;
+  // the budget is given in megabytes
+  memoryBudget = (size_t) _memoryBudget << 20;
+}
+
+fastqChunk * dmx::acquireChunk() {
+  fastqChunk * chunk;
+  if ( freeChunks.try_pop( chunk ) ) {
+    return chunk;
+  }
+  if ( allocatedChunks < chunkLimit ) {
+    ++allocatedChunks;
+    return new fastqChunk();
+  }
+  // every chunk is queued or being digested; wait for one to come back
+  freeChunks.pop( chunk );
+  return chunk;
+}
+
+size_t dmx::chunkBytes( fastqChunk * chunk ) {
+  // the input the chunk keeps alive, roughly: its records and their lines
+  size_t bytes = chunk->pairs.capacity() * sizeof( fastqPair );
+  for ( size_t i = 0; i < chunk->count; ++i ) {
+    fastqPair & fqp = chunk->pairs[ i ];
+    bytes += fqp.id1.size() + fqp.id2.size() + fqp.sq1.size() + 
+      fqp.sq2.size() + fqp.ql1.size() + fqp.ql2.size() + 8;
+  }
+  return bytes;
+}
+
+void dmx::initGrouping( const std::string & groupingName ) {
+  if ( groupingName == "sort" ) {
+    groupingKind = SORT_GROUPING;
+  }
+  else if ( groupingName == "hash" ) {
+    groupingKind = HASH_GROUPING;
+  }
+  else {
+    std::cerr << "Unknown grouping: " << groupingName << " (expected sort or hash)" << std::endl;
+    std::exit( 1 );
+  }
+}
+
+void dmx::initStorage( bool compact ) {
+  compactReads = compact;
+}
+
+void dmx::initOutput( const std::string & compressionName ) {
+  outputCompression = dmxWriter::parseCompression( compressionName );
+}
+
+void dmx::initStream( const std::string & outputPrefix ) {
+  // one interleaved fastq per barcode, in barcode index order, and the
+  // unassigned pairs last so that barcodeList.size() names them
+  std::vector< std::string > names;
+  for ( size_t i = 0; i < barcodeNames.size(); ++i ) {
+    names.push_back( outputName( outputPrefix + "." + barcodeNames[ i ] + ".interleaved.fastq" ) );
+  }
+  names.push_back( outputName( outputPrefix + ".unassigned.interleaved.fastq" ) );
+  streamSinks.open( names, outputCompression );
+  streaming = true;
+}
+
+void dmx::initClustering( const std::string & clusteringName, unsigned kmer ) {
+  if ( clusteringName == "dbscan" ) {
+#ifdef DMX_HAVE_LTILIB
+    clusteringKind = DBSCAN_CLUSTERING;
+#else
+    std::cerr << "DBScan clustering needs a build with ltilib (DMX_LTILIB)" << std::endl;
+    std::exit( 1 );
+#endif
+  }
+  else if ( clusteringName == "sketch" ) {
+    clusteringKind = SKETCH_CLUSTERING;
+  }
+  else {
+    std::cerr << "Unknown clustering " << clusteringName << " (dbscan or sketch)" << std::endl;
+    std::exit( 1 );
+  }
+  if ( kmer < minKmerLength || kmer > maxKmerLength ) {
+    std::cerr << "k-mer length must be from " << minKmerLength << " to " << maxKmerLength << std::endl;
+    std::exit( 1 );
+  }
+  kmerLength = kmer;
+}
+
+void dmx::initConsensus( const std::string & consensusName, bool _qualityVotes ) {
+  qualityVotes = _qualityVotes;
+  if ( consensusName == "star" ) {
+    consensusKind = STAR_CONSENSUS;
+  }
+  else if ( consensusName == "msa" ) {
+    consensusKind = MSA_CONSENSUS;
+  }
+  else {
+    std::cerr << "Unknown consensus " << consensusName << " (star or msa)" << std::endl;
+    std::exit( 1 );
+  }
+}
+
+void dmx::initSpill( unsigned megabytes, const std::string & outputPrefix ) {
+  if ( megabytes > 0 && groupingKind == HASH_GROUPING ) {
+    std::cerr << "Spilling reads needs --grouping sort" << std::endl;
+    std::exit( 1 );
+  }
+  spillBytes = (size_t) megabytes << 20;
+  fwdSpill.init( outputPrefix + ".spill.fwd" );
+  revSpill.init( outputPrefix + ".spill.rev" );
+  conSpill.init( outputPrefix + ".spill.con" );
 }
 
 void dmx::runFastq ( char* pair1FileName, char* pair2FileName ) {
   pairedEnd = true;
   fastqChunks.clear();
-  fastqFeed.clear();
+  freeChunks.clear();
+  allocatedChunks = 0;
+  // the pool already bounds the queue; the extra slot is for the end marker
+  fastqChunks.set_capacity( chunkLimit + 1 );
 
   dmxio = new dmxIO( pair1FileName, pair2FileName, chunkSize, 4 );
 
@@ -64,72 +231,143 @@ void dmx::runFastq ( char* pair1FileName, char* pair2FileName ) {
   std::cout << "finished reading and digesting..." << std::endl;
 }
 
+namespace {
+
+  struct splitBlockFunctor {
+    dmxFastqSplitter * splitter;
+    dmxBlock * block;
+    const char * data;
+    size_t length;
+    bool atEnd;
+    std::deque< fastqRecord > * records;
+
+    void operator()() const {
+      splitter->parse( block, data, length, atEnd, *records );
+    }
+  };
+}
+
 void dmx::read2FilePairedFastq( char * pair1FileName, char * pair2FileName ) {
   using namespace std;
 
-  printf( "Begin reading Paired Fastq Files...\n" );
+  task_scheduler_init init( numThreads );
 
-  int l = 0;
-  string line1, line2;
-  fastqPair fqp;
-  bool breaker = false;
+  printf( "Begin reading Paired Fastq Files...\n" );
 
-  vector< fastqPair > * chunk = new vector< fastqPair >();
-  chunk->reserve( chunkSize );
-  size_t itemsPerChunk = chunkSize;
+  // each mate is cut into records by its own splitter; within a block the
+  // splitting runs across TBB tasks, and both mates are parsed concurrently
+  size_t numRanges = numThreads > 0 ? numThreads : task_scheduler_init::default_num_threads();
+  dmxIOBuffer * buffer[ 2 ] = { dmxio->buffers[ pair1FileName ], dmxio->buffers[ pair2FileName ] };
+  dmxFastqSplitter splitter1( pair1FileName, trimSize, numRanges );
+  dmxFastqSplitter splitter2( pair2FileName, trimSize, numRanges );
+  dmxFastqSplitter * splitter[ 2 ] = { &splitter1, &splitter2 };
+  deque< fastqRecord > records[ 2 ];
+  bool more[ 2 ] = { true, true };
+  // records handed to chunks so far; the splitters keep their blocks until then
+  unsigned long long consumed[ 2 ] = { 0, 0 };
 
   unsigned n = 0;
   unsigned n_c = 0;
 
-  while ( !dmxio->ready() ) {
-    usleep(10);
-  }
+  for ( ; ; ) {
+    splitBlockFunctor split[ 2 ];
+    int numSplit = 0;
+    for ( int m = 0; m < 2; ++m ) {
+      if ( more[ m ] && records[ m ].size() < chunkSize ) {
+        split[ numSplit ].splitter = splitter[ m ];
+        split[ numSplit ].records = &records[ m ];
+        // a final call with no data flushes the record carried over at end of file
+        more[ m ] = buffer[ m ]->nextBlock( split[ numSplit ].data, split[ numSplit ].length );
+        if ( !more[ m ] ) {
+          split[ numSplit ].data = NULL;
+          split[ numSplit ].length = 0;
+        }
+        split[ numSplit ].atEnd = !more[ m ];
+        split[ numSplit ].block = buffer[ m ]->takeBlock();
+        ++numSplit;
+      }
+    }
+    if ( numSplit == 2 ) {
+      tbb::parallel_invoke( split[ 0 ], split[ 1 ] );
+    }
+    else if ( numSplit == 1 ) {
+      split[ 0 ]();
+    }
 
-  while ( !dmxio->isEmpty() ) {
-    if ( !dmxio->getline( pair1FileName, line1 ) ) breaker = true;
-    if ( !dmxio->getline( pair2FileName, line2 ) ) breaker = true;
-    //printf( "l = %d, n = %d, n_c = %d,  %s , %s\n", l, n, n_c, line1.c_str(), line2.c_str() );
-    if (breaker) { break; }
-    l++;
-    switch ( l ) {
-      case 1:
-        fqp.id1 = line1;
-        fqp.id2 = line2;
-        break;
-      case 2:
-        fqp.sq1 = line1.substr( trimSize, line1.size() );
-        fqp.sq2 = line2.substr( trimSize, line2.size() );
-        break;
-      case 3:
-        break;
-      case 4:
-        fqp.ql1 = line1.substr( trimSize, line1.size() );
-        fqp.ql2 = line2.substr( trimSize, line2.size() );
+    // mates are paired by record ordinal, so chunks stay exactly paired; once
+    // a mate has ended, everything it left can be paired with what is pending
+    bool done = ( !more[ 0 ] && records[ 0 ].size() <= records[ 1 ].size() ) || 
+      ( !more[ 1 ] && records[ 1 ].size() <= records[ 0 ].size() );
+    while ( ( records[ 0 ].size() >= chunkSize && records[ 1 ].size() >= chunkSize ) || 
+        ( done && !records[ 0 ].empty() && !records[ 1 ].empty() ) ) {
+      size_t k = min( (size_t) chunkSize, min( records[ 0 ].size(), records[ 1 ].size() ) );
+      fastqChunk * chunk = acquireChunk();
+      if ( chunk->pairs.size() < k ) {
+        chunk->pairs.resize( k );
+      }
+      // the pairs only point into the input, so the chunk keeps each block
+      // they use, once, until it has been digested
+      dmxBlock * last[ 2 ] = { NULL, NULL };
+      for ( size_t i = 0; i < k; ++i ) {
+        fastqPair & fqp = chunk->pairs[ i ];
+        fastqRecord & r1 = records[ 0 ].front();
+        fastqRecord & r2 = records[ 1 ].front();
+        if ( r1.block != last[ 0 ] ) {
+          chunk->retainBlock( r1.block );
+          last[ 0 ] = r1.block;
+        }
+        if ( r2.block != last[ 1 ] ) {
+          chunk->retainBlock( r2.block );
+          last[ 1 ] = r2.block;
+        }
+        fqp.id1 = r1.id;
+        fqp.id2 = r2.id;
+        fqp.sq1 = r1.seq;
+        fqp.sq2 = r2.seq;
+        fqp.ql1 = r1.qual;
+        fqp.ql2 = r2.qual;
         fqp.num = n;
         n++;
-        chunk->push_back( fqp ); 
-        fqp = fastqPair();
-        l = 0;
-        break;
-      default:
-        break;
-    }
-    if ( l == 0 && chunk->size() >= itemsPerChunk ) {
+        records[ 0 ].pop_front();
+        records[ 1 ].pop_front();
+      }
+      chunk->count = k;
+      consumed[ 0 ] += k;
+      consumed[ 1 ] += k;
+      splitter1.release( consumed[ 0 ] );
+      splitter2.release( consumed[ 1 ] );
+      if ( memoryBudget > 0 && n_c == 0 ) {
+        // size the pool from the first chunk, keeping at least one in flight
+        size_t budgetChunks = max( (size_t) 1, memoryBudget / max( (size_t) 1, chunkBytes( chunk ) ) );
+        chunkLimit = min( chunkLimit, budgetChunks );
+        printf( "Memory budget allows %lu chunks in flight\n", (unsigned long) chunkLimit );
+      }
       fastqChunks.push( chunk );
-      chunk = new vector< fastqPair >;
-      chunk->reserve( chunkSize );
       ++n_c;
     }
+    if ( done ) {
+      break;
+    }
   }
 
-  if ( chunk->size() > 0 ) {
-    fastqChunks.push( chunk );
+  // the longer mate may only have its end-of-file flush left
+  for ( int m = 0; m < 2; ++m ) {
+    while ( more[ m ] && records[ m ].empty() ) {
+      const char * data;
+      size_t length;
+      more[ m ] = buffer[ m ]->nextBlock( data, length );
+      splitter[ m ]->parse( buffer[ m ]->takeBlock(), more[ m ] ? data : NULL, more[ m ] ? length : 0, !more[ m ], records[ m ] );
+    }
   }
-  finishedReading = true;
+  if ( !records[ 0 ].empty() || !records[ 1 ].empty() ) {
+    printf( "Paired Fastq Files contain different numbers of reads; stopping after %d pairs\n", n );
+  }
+  dmxio->drain();
+
+  fastqChunks.push( NULL );
   printf( "Finished reading Paired Fastq Files. Contained %d reads, %d chunks...\n", n, n_c );
 }
 
-
 int dmx::readBarcodeFile(char* barcodeFileName) {
   printf( "Begin reading barcode file...\n");
   std::ifstream barcodeFile (barcodeFileName);
@@ -151,344 +389,660 @@ int dmx::readBarcodeFile(char* barcodeFileName) {
   if (!barcodeFile.eof()) {
     std::cerr << "Inconceivable!\n";
   }
-
-  resize( barcodeStringSet, barcodes.size() );
-  for ( size_t i = 0; i < barcodeNames.size(); ++i ) {
-    barcodeStringSet[ i ] = barcodes[ barcodeNames[ i ] ].barcodeString;
+  if ( barcodeNames.empty() ) {
+    std::cerr << "No barcodes in " << barcodeFileName << std::endl;
+    std::exit( 1 );
   }
-  barcodeStringSetIndex = barcodeStringSetType( barcodeStringSet );
-  barcodeFinder = barcodeStringSetIndexType( barcodeStringSetIndex );
   printf( "Finished reading barcode file...\n");
   return 0;
 }
 
-dmxMatch dmx::getMatchIndexFinder( std::string seq, barcodeStringSetIndexFinderType * _barcodeFinder ) {
-  dmxMatch m;
-  m.min = 6;
-  m.index = 0;
-
-  clear( * _barcodeFinder );
-  while ( find( * _barcodeFinder, seq.substr(27,6) ) ) {
-    m.index = position( * _barcodeFinder ).i1;
-    m.min = 0;
-    return m;
-  }
-  return m;
-}
-
-void dmx::digest() {
-  for ( concurrent_vector< std::vector< fastqPair > * >::iterator chunk = fastqFeed.begin();
-      chunk != fastqFeed.end(); ++chunk ) {
-    digest( &barcodeFinder, *chunk );
-  }
-}
-
-void dmx::digest( barcodeStringSetIndexFinderType *_barcodeFinder, std::vector< fastqPair > * fastqFeedChunk ) {
+void dmx::digest( fastqChunk * fastqFeedChunk ) {
 
   using namespace std;
 
-  for ( std::vector< fastqPair >::iterator pairIt = (*fastqFeedChunk).begin();
-      pairIt != (*fastqFeedChunk).end(); ++pairIt ) {
-
-    string & fwdMate = (*pairIt).sq1;
-    string & revMate = (*pairIt).sq2;
-    string & fwdMateQual = (*pairIt).ql1;
-    string & revMateQual = (*pairIt).ql2;
+  // barcodes are found for the whole chunk, one mate at a time, up front
+  size_t count = fastqFeedChunk->count;
+  std::vector< dmxView > fwdSeqs( count ), revSeqs( count );
+  for ( size_t i = 0; i < count; ++i ) {
+    fwdSeqs[ i ] = fastqFeedChunk->pairs[ i ].sq1;
+    revSeqs[ i ] = fastqFeedChunk->pairs[ i ].sq2;
+  }
+  std::vector< dmxMatch > fwdMatches, revMatches;
+  size_t heldBefore = spillBytes > 0 ? localHeldBytes() : 0;
+  matchMates( fwdSeqs, fwdMatches );
+  matchMates( revSeqs, revMatches );
+
+  std::vector< fastqPair >::iterator pairsEnd = fastqFeedChunk->pairs.begin() + count;
+  for ( std::vector< fastqPair >::iterator pairIt = fastqFeedChunk->pairs.begin();
+      pairIt != pairsEnd; ++pairIt ) {
+    size_t i = pairIt - fastqFeedChunk->pairs.begin();
+
+    const dmxView & fwdMate = (*pairIt).sq1;
+    const dmxView & revMate = (*pairIt).sq2;
+    const dmxView & fwdMateQual = (*pairIt).ql1;
+    const dmxView & revMateQual = (*pairIt).ql2;
     int r = (*pairIt).num;
 
-    dmxMatch fwdMatch = getMatchIndexFinder( fwdMate, _barcodeFinder );
+    dmxMatch & fwdMatch = fwdMatches[ i ];
     //dmxMatch fwdMatch = getExactMatch( fwdMate );
 
     unsigned fwdMin = fwdMatch.min;
     int fwdMinIndex = fwdMatch.index;
 
-    dmxMatch revMatch = getMatchIndexFinder( revMate, _barcodeFinder );
+    dmxMatch & revMatch = revMatches[ i ];
     //dmxMatch revMatch = getExactMatch( revMate );
 
     unsigned revMin = revMatch.min;
     int revMinIndex = revMatch.index;
 
+    // a mate without a barcode has index -1 and a distance above every
+    // threshold, so only the branches below that ignore its barcode apply
     barcodeAssignmentType BCA = NO_MATCH;
-    barcode & fBC = barcodes[ barcodeNames[ fwdMinIndex ] ];
-    barcode & rBC = barcodes[ barcodeNames[ revMinIndex ] ];
-
-    if ( fwdMin > fBC.maxBarcodeDistance && revMin > rBC.maxBarcodeDistance ) {
+    barcode & fBC = *barcodeList[ fwdMinIndex >= 0 ? fwdMinIndex : 0 ];
+    barcode & rBC = *barcodeList[ revMinIndex >= 0 ? revMinIndex : 0 ];
+
+    // where the layout parts start, moved along with a re-anchored primer
+    unsigned fTagStart = fBC.randTagStart + fwdMatch.shift;
+    unsigned fPrimerStart = fBC.randPrimerStart + fwdMatch.shift;
+    unsigned fSeqStart = fBC.seqStart + fwdMatch.shift;
+    unsigned rTagStart = rBC.randTagStart + revMatch.shift;
+    unsigned rPrimerStart = rBC.randPrimerStart + revMatch.shift;
+    unsigned rSeqStart = rBC.seqStart + revMatch.shift;
+
+    // what is kept of each mate: the sequence after the layout for a mate
+    // with a barcode, the whole mate otherwise
+    bool fHit = fwdMin <= fBC.maxBarcodeDistance;
+    bool rHit = revMin <= rBC.maxBarcodeDistance;
+    dmxReadKey key;
+    dmxReadStore * store;
+    dmxReadGroupMap * groups = NULL;
+    // the per-barcode file a streamed read goes to; the last one takes the rest
+    size_t sink = barcodeList.size();
+
+    if ( !fHit && !rHit ) {
       BCA = NO_MATCH;
-      dmxRead * read = new dmxRead( NO_MATCH, "", r );
-      read->fwd( -1, fwdMate, fwdMateQual );
-      read->rev( -1, revMate, revMateQual );
-      nonBarcode.push( read );
-    }
-    else if (fwdMinIndex == revMinIndex) { 
-      if (fwdMin <= fBC.maxBarcodeDistance || 
-          revMin <= rBC.maxBarcodeDistance ) {
-        BCA = BOTH;
-        dmxRead * read = new dmxRead(
-            BOTH,
-            fwdMate.substr( fBC.randTagStart, fBC.randTagLength ) +
-            fwdMate.substr( fBC.randPrimerStart, fBC.randPrimerLength ) +
-            fwdMate.substr( fBC.seqStart, seqTagLength ) +
-            revMate.substr( rBC.randTagStart, rBC.randTagLength ) +
-            revMate.substr( rBC.randPrimerStart, rBC.randPrimerLength ) +
-            revMate.substr( rBC.seqStart, seqTagLength ),
-            r );
-        read->fwd( fwdMinIndex, fwdMate.substr( fBC.seqStart, fwdMate.length() - fBC.seqStart ), fwdMateQual.substr( fBC.seqStart, fwdMate.length() - fBC.seqStart ) );
-        read->rev( revMinIndex, revMate.substr( rBC.seqStart, revMate.length() - rBC.seqStart ), revMateQual.substr( rBC.seqStart, revMate.length() - rBC.seqStart ) );
-        conBarcode.push( read );
-      }
+      store = &nonBarcode;
+    }
+    else if ( fwdMinIndex == revMinIndex ) {
+      BCA = BOTH;
+      store = &conBarcode;
+      groups = &conGroups;
+      sink = fwdMinIndex;
+    }
+    else if ( fHit && !rHit ) {
+      BCA = FWD;
+      store = &fwdBarcode;
+      groups = &fwdGroups;
+      sink = fwdMinIndex;
+    }
+    else if ( !fHit && rHit ) {
+      BCA = REV;
+      store = &revBarcode;
+      groups = &revGroups;
+      sink = revMinIndex;
     }
     else {
-      if (fwdMin <= fBC.maxBarcodeDistance && 
-          revMin > rBC.maxBarcodeDistance ) {
-        BCA = FWD;
-        dmxRead * read = new dmxRead(
-            FWD,
-            fwdMate.substr( fBC.randTagStart, fBC.randTagLength ) +
-            fwdMate.substr( fBC.randPrimerStart, fBC.randPrimerLength ) +
-            fwdMate.substr( fBC.seqStart, seqTagLength ), 
-            r );
-        read->fwd( fwdMinIndex, fwdMate.substr( fBC.seqStart, fwdMate.length() - fBC.seqStart ), fwdMateQual.substr( fBC.seqStart, fwdMate.length() - fBC.seqStart ) );
-        read->rev( -1, revMate, revMateQual );
-        fwdBarcode.push( read );
-      }
-      else if (fwdMin > fBC.maxBarcodeDistance && 
-          revMin <= rBC.maxBarcodeDistance ) {
-        BCA = REV;
-        dmxRead * read = new dmxRead(
-            REV,
-            revMate.substr( rBC.randTagStart, rBC.randTagLength ) +
-            revMate.substr( rBC.randPrimerStart, rBC.randPrimerLength ) +
-            revMate.substr( rBC.seqStart, seqTagLength ),
-            r );
-        read->fwd( -1, fwdMate, fwdMateQual );
-        read->rev( revMinIndex, revMate.substr( rBC.seqStart, revMate.length() - rBC.seqStart ), revMateQual.substr( rBC.seqStart, revMate.length() - rBC.seqStart ) );
-        revBarcode.push( read );
-      }
-      else if (fwdMin <= fBC.maxBarcodeDistance && 
-          revMin <= rBC.maxBarcodeDistance ) {
-        BCA = MISMATCH;
-        dmxRead * read = new dmxRead(
-            MISMATCH,
-            fwdMate.substr( fBC.randTagStart, fBC.randTagLength ) +
-            fwdMate.substr( fBC.randPrimerStart, fBC.randPrimerLength ) +
-            fwdMate.substr( fBC.seqStart, seqTagLength ) +
-            revMate.substr( rBC.randTagStart, rBC.randTagLength ) +
-            revMate.substr( rBC.randPrimerStart, rBC.randPrimerLength ) +
-            revMate.substr( rBC.seqStart, seqTagLength ),
-            r );       
-        read->fwd( fwdMinIndex, fwdMate.substr( fBC.seqStart, fwdMate.length() - fBC.seqStart ), fwdMateQual.substr( fBC.seqStart, fwdMate.length() - fBC.seqStart ) );
-        read->rev( revMinIndex, revMate.substr( fBC.seqStart, revMate.length() - rBC.seqStart ), revMateQual.substr( fBC.seqStart, revMate.length() - rBC.seqStart ) );
-        disBarcode.push( read );
-      }
+      BCA = MISMATCH;
+      store = &disBarcode;
+    }
+
+    if ( fHit ) {
+      key.appendFwd( fwdMate, fTagStart, fBC.randTagLength );
+      key.appendFwd( fwdMate, fPrimerStart, fBC.randPrimerLength );
+      key.appendFwd( fwdMate, fSeqStart, seqTagLength );
+    }
+    if ( rHit ) {
+      key.appendRev( revMate, rTagStart, rBC.randTagLength );
+      key.appendRev( revMate, rPrimerStart, rBC.randPrimerLength );
+      key.appendRev( revMate, rSeqStart, seqTagLength );
+    }
+    int fIdx = fHit ? fwdMinIndex : -1;
+    int rIdx = rHit ? revMinIndex : -1;
+    size_t fStart = fHit ? fSeqStart : 0;
+    size_t rStart = rHit ? rSeqStart : 0;
+
+    if ( streaming ) {
+      // written straight out of the chunk, never stored
+      dmxRead read( BCA, key, r );
+      read.borrowFwd( fIdx, fwdMate, fwdMateQual, fStart );
+      read.borrowRev( rIdx, revMate, revMateQual, rStart );
+      read.formatFastq( r, streamSinks.buffer( sink ) );
+      streamSinks.added( sink );
+      continue;
+    }
+
+    dmxRead * read = store->newRead( BCA, key, r );
+    read->fwd( fIdx, fwdMate, fwdMateQual, fStart, store->arena(), compactReads );
+    read->rev( rIdx, revMate, revMateQual, rStart, store->arena(), compactReads );
+    if ( groups != NULL ) {
+      addGroupedRead( *store, *groups, read );
+    }
+    else {
+      store->reads.local().push_back( read );
     }
-    (*pairIt) = fastqPair();
+  }
+
+  if ( spillBytes > 0 ) {
+    spillLocalReads( heldBefore );
   }
 }
 
-void dmx::parallelDigest2() {
-  digestFunctor2 df;
-  df.d = this;
+size_t dmx::localHeldBytes() {
+  return fwdBarcode.arena().bytesReserved() + revBarcode.arena().bytesReserved() +
+    conBarcode.arena().bytesReserved();
+}
 
-  // wait for some work to build up...
-  while ( fastqChunks.empty() ) {
-    usleep( 10 ); // TODO: CLEANUP
+void dmx::spillLocalReads( size_t heldBefore ) {
+  size_t held = localHeldBytes();
+  heldBytes += held - heldBefore;
+  if ( heldBytes <= spillBytes ) {
+    return;
   }
+  // every worker spills its own reads as it sees the threshold crossed
+  spillLocal( fwdBarcode, fwdSpill );
+  spillLocal( revBarcode, revSpill );
+  spillLocal( conBarcode, conSpill );
+  heldBytes -= held;
+}
 
-  printf( "Digesting...\n" );
+void dmx::spillLocal( dmxReadStore & store, dmxSpill & spill ) {
+  dmxReadSerialVector & reads = store.reads.local();
+  spill.writeRun( reads );
+  dmxReadSerialVector().swap( reads );
+  store.arena().release();
+}
+
+void dmx::spillRemainingReads( dmxReadStore & store, dmxSpill & spill ) {
+  if ( spill.runs() == 0 ) {
+    return;
+  }
+  for ( dmxReadLocalVectors::iterator it = store.reads.begin(); it != store.reads.end(); ++it ) {
+    spill.writeRun( *it );
+  }
+  store.release();
+}
 
-  fastqFeed.reserve( fastqChunks.unsafe_size() * 2 );
+void dmx::addGroupedRead( dmxReadStore & store, dmxReadGroupMap & groups, dmxRead * read ) {
+  if ( groupingKind == HASH_GROUPING ) {
+    dmxReadGroupMap::accessor a;
+    groups.insert( a, read->key );
+    a->second.push_back( read );
+  }
+  else {
+    store.reads.local().push_back( read );
+  }
+}
 
-  int numChunks = fastqChunks.unsafe_size();
-  for ( int i = 0; i < numChunks; ++i ) {
-    std::vector< fastqPair > * chunk;
-    fastqChunks.try_pop( chunk );
-    fastqFeed.push_back( chunk );
+void dmx::matchMates( const std::vector< dmxView > & seqs, std::vector< dmxMatch > & matches ) {
+  size_t n = seqs.size();
+  matches.resize( n );
+  if ( n == 0 ) {
+    return;
+  }
+  if ( matcherKind == MYERS_MATCHER ) {
+    myersMatcher.match( &seqs[ 0 ], n, &matches[ 0 ] );
+  }
+  else {
+    for ( size_t i = 0; i < n; ++i ) {
+      matches[ i ] = matcher.match( seqs[ i ] );
+    }
+  }
+  if ( !anchor.enabled() ) {
+    return;
   }
 
-  parallel_do( fastqFeed.begin(), fastqFeed.end(), df );
-  while ( !finishedReading ) { 
-    parallel_do( fastqFeed.begin(), fastqFeed.end(), df );
-  } // TODO: clean this up ...
-  
-  fastqFeed.clear();
-  fastqFeed.shrink_to_fit();
+  // only reads that missed at the layout position look for the primer, and
+  // only those where it has moved are matched again
+  std::vector< size_t > missed;
+  std::vector< dmxView > missedSeqs;
+  for ( size_t i = 0; i < n; ++i ) {
+    if ( matches[ i ].index < 0 ) {
+      missed.push_back( i );
+      missedSeqs.push_back( seqs[ i ] );
+    }
+  }
+  if ( missed.empty() ) {
+    return;
+  }
+  std::vector< int > shifts( missed.size() );
+  anchor.locate( &missedSeqs[ 0 ], missed.size(), &shifts[ 0 ] );
+
+  std::vector< size_t > moved;
+  std::vector< dmxView > movedSeqs;
+  std::vector< int > movedShifts;
+  for ( size_t j = 0; j < missed.size(); ++j ) {
+    if ( shifts[ j ] != 0 ) {
+      moved.push_back( missed[ j ] );
+      movedSeqs.push_back( missedSeqs[ j ] );
+      movedShifts.push_back( shifts[ j ] );
+    }
+  }
+  if ( moved.empty() ) {
+    return;
+  }
+  std::vector< dmxMatch > movedMatches( moved.size() );
+  if ( matcherKind == MYERS_MATCHER ) {
+    myersMatcher.match( &movedSeqs[ 0 ], moved.size(), &movedMatches[ 0 ], &movedShifts[ 0 ] );
+  }
+  else {
+    for ( size_t k = 0; k < moved.size(); ++k ) {
+      movedMatches[ k ] = matcher.match( movedSeqs[ k ], movedShifts[ k ] );
+    }
+  }
+  for ( size_t k = 0; k < moved.size(); ++k ) {
+    if ( movedMatches[ k ].index >= 0 ) {
+      matches[ moved[ k ] ] = movedMatches[ k ];
+    }
+  }
+}
 
-  fastqChunks.clear();
+void dmx::parallelDigest2() {
+  // this runs on its own thread, which needs its own scheduler to honor numThreads
+  task_scheduler_init init( numThreads );
+
+  printf( "Digesting...\n" );
+
+  chunkSourceFilter source;
+  source.d = this;
+  digestFilter match;
+  match.d = this;
+  chunkSinkFilter sink;
+  sink.d = this;
+
+  parallel_pipeline( maxTokens,
+      make_filter< void, fastqChunk * >( filter::serial_in_order, source ) &
+      make_filter< fastqChunk *, fastqChunk * >( filter::parallel, match ) &
+      make_filter< fastqChunk *, void >( filter::serial_out_of_order, sink ) );
+
+  // the reader is done by now, so every chunk is back in the pool
+  fastqChunk * chunk;
+  while ( freeChunks.try_pop( chunk ) ) {
+    delete chunk;
+  }
+
+  if ( streaming ) {
+    for ( size_t s = 0; s < streamSinks.size(); ++s ) {
+      printf( "%s %lu\n", streamSinks.fileName( s ).c_str(), streamSinks.records( s ) );
+    }
+    streamSinks.close();
+    return;
+  }
 
-  spoon = true;
   // TODO these should be elsewhere...
-  convertPriorityQueuesToVectors();
+  if ( groupingKind == HASH_GROUPING ) {
+    printf( "FWD %lu groups\n", fwdGroups.size() );
+    printf( "REV %lu groups\n", revGroups.size() );
+    printf( "CON %lu groups\n", conGroups.size() );
+  }
+  else {
+    spillRemainingReads( fwdBarcode, fwdSpill );
+    spillRemainingReads( revBarcode, revSpill );
+    spillRemainingReads( conBarcode, conSpill );
+    gatherResults( fwdBarcode.reads, fwdBarcodeSerVec );
+    printf( "FWD %lu\n", fwdBarcodeSerVec.size() + fwdSpill.records() );
+    gatherResults( revBarcode.reads, revBarcodeSerVec );
+    printf( "REV %lu\n", revBarcodeSerVec.size() + revSpill.records() );
+    gatherResults( conBarcode.reads, conBarcodeSerVec );
+    printf( "CON %lu\n", conBarcodeSerVec.size() + conSpill.records() );
+    if ( fwdSpill.runs() + revSpill.runs() + conSpill.runs() > 0 ) {
+      printf( "Spilled %lu runs\n", fwdSpill.runs() + revSpill.runs() + conSpill.runs() );
+    }
+  }
+  gatherResults( disBarcode.reads, disBarcodeSerVec );
+  printf( "DIS %lu\n", disBarcodeSerVec.size() );
+  gatherResults( nonBarcode.reads, nonBarcodeSerVec );
+  printf( "NON %lu\n", nonBarcodeSerVec.size() );
+
   groupReduce();
-  convertPriorityQueuesToVectors();
+
+  // only the barcoded categories are reduced
+  gatherResults( fwdBarcode.reads, fwdBarcodeSerVec );
+  printf( "FWD %lu\n", fwdBarcodeSerVec.size() );
+  gatherResults( revBarcode.reads, revBarcodeSerVec );
+  printf( "REV %lu\n", revBarcodeSerVec.size() );
+  gatherResults( conBarcode.reads, conBarcodeSerVec );
+  printf( "CON %lu\n", conBarcodeSerVec.size() );
 }
 
-void dmx::convertPriorityQueueToVector( dmxReadPriQ & q, dmxReadSerialVector & v ) {
+void dmx::gatherResults( dmxReadLocalVectors & locals, dmxReadSerialVector & v ) {
   v.clear();
-  dmxRead * r;
-  while ( q.try_pop(r) ) {
-    v.push_back( r );
+  size_t total = 0;
+  for ( dmxReadLocalVectors::iterator it = locals.begin(); it != locals.end(); ++it ) {
+    total += it->size();
+  }
+  v.reserve( total );
+  for ( dmxReadLocalVectors::iterator it = locals.begin(); it != locals.end(); ++it ) {
+    v.insert( v.end(), it->begin(), it->end() );
+    dmxReadSerialVector().swap( *it );
   }
+  // reads of a group end up next to each other
+  parallel_sort( v.begin(), v.end(), dmxReadCompare() );
 }
 
-void dmx::convertPriorityQueuesToVectors() {
-  // popping from priority queues is slow and inherently serial
-  // copy everything into vectors in preparation for subsequent 
-  // parallel processing.  Seems to be significantly faster if
-  // the copying is done in parallel
-#pragma omp parallel sections
-  {
-#pragma omp section
-    {
-      convertPriorityQueueToVector( fwdBarcode, fwdBarcodeSerVec );  
-      printf( "FWD %lu\n", fwdBarcodeSerVec.size() );
-    }
-#pragma omp section
-    {
-      convertPriorityQueueToVector( revBarcode, revBarcodeSerVec );  
-      printf( "REV %lu\n", revBarcodeSerVec.size() );
-    }
-#pragma omp section
-    {
-      convertPriorityQueueToVector( conBarcode, conBarcodeSerVec );  
-      printf( "CON %lu\n", conBarcodeSerVec.size() );
-    }
-#pragma omp section
-    {
-      convertPriorityQueueToVector( disBarcode, disBarcodeSerVec );  
-      printf( "DIS %lu\n", disBarcodeSerVec.size() );
-    }
-#pragma omp section
-    {
-      convertPriorityQueueToVector( nonBarcode, nonBarcodeSerVec );  
-      printf( "NON %lu\n", nonBarcodeSerVec.size() );
-    }
+void dmxReadStore::release() {
+  for ( dmxReadLocalVectors::iterator it = reads.begin(); it != reads.end(); ++it ) {
+    dmxReadSerialVector().swap( *it );
+  }
+  for ( dmxLocalArenas::iterator it = arenas.begin(); it != arenas.end(); ++it ) {
+    it->release();
   }
 }
 
+void dmx::releaseReads() {
+  fwdBarcodeSerVec.clear();
+  revBarcodeSerVec.clear();
+  conBarcodeSerVec.clear();
+  disBarcodeSerVec.clear();
+  nonBarcodeSerVec.clear();
+  fwdBarcode.release();
+  revBarcode.release();
+  conBarcode.release();
+  disBarcode.release();
+  nonBarcode.release();
+}
+
 void dmx::groupReduce() {
   std::cout << "group reduce" << std::endl;
-#pragma omp parallel sections
-  {
-#pragma omp section
-    { groupReduce( &fwdBarcodeSerVec, &fwdBarcode ); }
-#pragma omp section
-    { groupReduce( &revBarcodeSerVec, &revBarcode ); }
-#pragma omp section
-    { groupReduce( &conBarcodeSerVec, &conBarcode ); }
+  // each category is reduced across all workers in turn
+  tick_count start = tick_count::now();
+  groupReduce( &fwdBarcodeSerVec, &fwdGroups, &fwdBarcode, &fwdSpill );
+  reportGroupReduce( "FWD", ( tick_count::now() - start ).seconds() );
+  start = tick_count::now();
+  groupReduce( &revBarcodeSerVec, &revGroups, &revBarcode, &revSpill );
+  reportGroupReduce( "REV", ( tick_count::now() - start ).seconds() );
+  start = tick_count::now();
+  groupReduce( &conBarcodeSerVec, &conGroups, &conBarcode, &conSpill );
+  reportGroupReduce( "CON", ( tick_count::now() - start ).seconds() );
+}
+
+void dmx::reduceTiming::add( double seconds, size_t size, const dmxReadKey & key ) {
+  work += seconds;
+  ++groups;
+  if ( seconds > slowest ) {
+    slowest = seconds;
+    slowestSize = size;
+    slowestKey = key;
   }
 }
 
-void dmx::groupReduce( dmxReadSerialVector * drsv, dmxReadPriQ * drpq ) {
-  // runs through barcode vectors and groups, then clusters, then reduces
-  // each stack to a consensus, inserts into priority queues...
-  // uses the 'spoon feeding' parallel_do approach...
-  tbb::atomic< bool > * my_spoon = new tbb::atomic< bool >();
-  (*my_spoon) = true;
-  tbb::concurrent_vector< dmxReadSerialVector * > groupReduceFeed; 
+void dmx::reduceTiming::add( const reduceTiming & other ) {
+  work += other.work;
+  groups += other.groups;
+  if ( other.slowest > slowest ) {
+    slowest = other.slowest;
+    slowestSize = other.slowestSize;
+    slowestKey = other.slowestKey;
+  }
+}
 
-  size_t bufferCount = 0;
-  size_t bufferSize = 10;
+void dmx::reportGroupReduce( const char * category, double seconds ) {
+  reduceTiming total;
+  for ( enumerable_thread_specific< reduceTiming >::iterator it = reduceTimes.begin(); it != reduceTimes.end(); ++it ) {
+    total.add( *it );
+  }
+  reduceTimes.clear();
+  if ( total.groups == 0 ) {
+    return;
+  }
+  printf( "%s reduced %lu groups in %.2f s (%.2f s of work)\n", category, total.groups, seconds, total.work );
+  // when the slowest group takes about as long as the whole reduce, it is
+  // what decides the run time
+  printf( "%s slowest group: %lu reads, %.2f s (%.0f%% of the reduce), barcodes %d/%d tag %s\n",
+      category, total.slowestSize, total.slowest, seconds > 0 ? 100.0 * total.slowest / seconds : 0.0,
+      total.slowestKey.fBCidx, total.slowestKey.rBCidx, total.slowestKey.tagString().c_str() );
+}
 
-  dmxReadSerialVector * stack = new dmxReadSerialVector();
-  
-  for ( dmxReadSerialVector::iterator it = drsv->begin(); it != drsv->end(); ++it ) {
-    if ( stack->empty() ) {
-      stack->push_back( *it );
-      (*it) = NULL;
+void dmx::groupReduce( dmxReadSerialVector * drsv, dmxReadGroupMap * groups, dmxReadStore * drpq, dmxSpill * spill ) {
+  // groups are condensed in parallel, each to one representative per
+  // cluster, appended to the per-thread vectors of drpq; the reads they
+  // came from stay in its arenas until the category is released
+  if ( groupingKind == HASH_GROUPING ) {
+    std::vector< groupRef > refs;
+    refs.reserve( groups->size() );
+    for ( dmxReadGroupMap::iterator it = groups->begin(); it != groups->end(); ++it ) {
+      groupRef ref;
+      ref.reads = &it->second[ 0 ];
+      ref.size = it->second.size();
+      refs.push_back( ref );
     }
-    else {
-      if ( *(*it) == *( stack->back() ) ) {
-        stack->push_back( *it );
-        (*it) = NULL;
-      }
-      else {
-        groupReduceFeed.push_back( stack );
-        stack = new dmxReadSerialVector();
-        bufferCount++;
+    reduceLargestFirst( refs, drpq );
+    groups->clear();
+    return;
+  }
+
+  if ( spill->runs() > 0 ) {
+    mergeReduce( spill, drpq );
+    spill->remove();
+    return;
+  }
+
+  // sorted: a group starts wherever a read's key differs from the one
+  // before it; the starts are marked in parallel and reduced in parallel
+  size_t n = drsv->size();
+  if ( n == 0 ) {
+    return;
+  }
+  std::vector< char > isStart( n );
+  groupStartFunctor mark;
+  mark.drsv = drsv;
+  mark.isStart = &isStart;
+  parallel_for( blocked_range< size_t >( 0, n ), mark );
+
+  std::vector< groupRef > refs;
+  for ( size_t i = 0; i < n; ++i ) {
+    if ( isStart[ i ] ) {
+      if ( !refs.empty() ) {
+        refs.back().size = &(*drsv)[ i ] - refs.back().reads;
       }
-    }
-    if ( bufferCount == bufferSize || bufferCount == drsv->size() ) {
-      break;
+      groupRef ref;
+      ref.reads = &(*drsv)[ i ];
+      refs.push_back( ref );
     }
   }
-  parallel_do( groupReduceFeed.begin(), groupReduceFeed.end(), dmx::groupReduceFunctor( this, drsv, drpq, my_spoon ) );
+  refs.back().size = &(*drsv)[ 0 ] + n - refs.back().reads;
+
+  reduceLargestFirst( refs, drpq );
   drsv->clear();
 }
 
-void dmx::groupReduceFunctor::operator() ( dmxReadSerialVector * r, parallel_do_feeder< dmxReadSerialVector * >& feeder ) const {
-  
-  if ( group_reduce_spoon->compare_and_swap( false, true ) ) {
-    // I have the group_reduce_spoon, so I must be the feeder...
-    // following loop only entered by the feeder
-    dmxReadSerialVector * stack = new dmxReadSerialVector();
+void dmx::reduceLargestFirst( std::vector< groupRef > & refs, dmxReadStore * drpq ) {
+  // groups that get clustered go to the front, largest first; the small ones
+  // keep their order
+  std::vector< groupRef >::iterator clusteredEnd = std::stable_partition( refs.begin(), refs.end(), clusteredGroup() );
+  std::sort( refs.begin(), clusteredEnd, groupRefLarger() );
+
+  // every worker takes the next clustered group, or block of small groups,
+  // until there are none left
+  tbb::atomic< size_t > next;
+  next = 0;
+  largestFirstFunctor reduce;
+  reduce.d = this;
+  reduce.refs = &refs;
+  reduce.clustered = clusteredEnd - refs.begin();
+  reduce.next = &next;
+  reduce.drpq = drpq;
+  size_t workers = numThreads > 0 ? numThreads : task_scheduler_init::default_num_threads();
+  parallel_for( blocked_range< size_t >( 0, workers, 1 ), reduce, simple_partitioner() );
+}
 
-    for ( dmxReadSerialVector::iterator it = drsv->begin(); it != drsv->end(); ++it ) {
-      if ( (*it) != NULL ) {
-        if ( stack->empty() ) {
-          stack->push_back( *it );
-        }
-        else {
-          if ( *(*it) == *( stack->back() ) ) {
-            stack->push_back( *it );
-          }
-          else {
-            feeder.add( stack );
-            stack = new dmxReadSerialVector();
+namespace {
+
+  // whole groups of merged reads, rebuilt in an arena of their own that
+  // goes away once they are reduced
+  struct mergeBatch {
+    dmxArena arena;
+    dmxReadSerialVector reads;
+    std::vector< size_t > starts;
+  };
+
+  const size_t mergeBatchReads = 1 << 14;
+
+  struct mergeSourceFilter {
+    dmxRunMerger * merger;
+    mergeBatch * operator()( flow_control & fc ) const {
+      dmxReadKey key;
+      if ( !merger->peek( key ) ) {
+        fc.stop();
+        return NULL;
+      }
+      mergeBatch * batch = new mergeBatch();
+      // a batch only ends where a group does
+      while ( merger->peek( key ) ) {
+        bool starts = batch->reads.empty() || !( key == batch->reads.back()->key );
+        if ( starts ) {
+          if ( batch->reads.size() >= mergeBatchReads ) {
+            break;
           }
+          batch->starts.push_back( batch->reads.size() );
         }
+        batch->reads.push_back( merger->next( batch->arena ) );
       }
+      batch->starts.push_back( batch->reads.size() );
+      return batch;
     }
-  }
+  };
 
-  // executed by all tasks, including, eventually, the feeder:
-  if ( r->size() > 0 ) {
+  struct mergeReduceFilter {
+    dmx * d;
+    dmxReadStore * drpq;
+    mergeBatch * operator()( mergeBatch * batch ) const {
+      dmxReadSerialVector group;
+      for ( size_t g = 0; g + 1 < batch->starts.size(); ++g ) {
+        group.assign( batch->reads.begin() + batch->starts[ g ], batch->reads.begin() + batch->starts[ g + 1 ] );
+        d->reduceGroup( group, drpq, true );
+      }
+      return batch;
+    }
+  };
 
-    std::map< int, dmxReadSerialVector > clusterMap;
-    // TODO parameterize the minimumum size to condense; randomly select from vector when below size
+  struct mergeSinkFilter {
+    void operator()( mergeBatch * batch ) const {
+      delete batch;
+    }
+  };
+}
 
-    dmxRead * processedRead;
+void dmx::mergeReduce( dmxSpill * spill, dmxReadStore * drpq ) {
+  // the merge is serial, but batches of groups are reduced in parallel;
+  // runs are first merged down to a bounded fan-in, and the read buffers
+  // share the spill threshold
+  spill->limitRuns( dmxRunMerger::maxFanIn, dmxRunMerger::bufferBytes( spillBytes, dmxRunMerger::maxFanIn ) );
+  dmxRunMerger merger( spill->fileNames(), dmxRunMerger::bufferBytes( spillBytes, spill->runs() ) );
+  mergeSourceFilter source;
+  source.merger = &merger;
+  mergeReduceFilter reduce;
+  reduce.d = this;
+  reduce.drpq = drpq;
+  mergeSinkFilter sink;
+
+  parallel_pipeline( maxTokens,
+      make_filter< void, mergeBatch * >( filter::serial_in_order, source ) &
+      make_filter< mergeBatch *, mergeBatch * >( filter::parallel, reduce ) &
+      make_filter< mergeBatch *, void >( filter::serial_out_of_order, sink ) );
+}
 
-    if ( r->size() > 100 ) {
-      d->getClusters( clusterMap, r );
+void dmx::groupStartFunctor::operator() ( const blocked_range< size_t > & r ) const {
+  for ( size_t i = r.begin(); i != r.end(); ++i ) {
+    (*isStart)[ i ] = i == 0 || !( *(*drsv)[ i ] == *(*drsv)[ i - 1 ] );
+  }
+}
 
-      for ( std::map< int, dmxReadSerialVector >::iterator it = clusterMap.begin(); it != clusterMap.end(); ++it ) {
-        if ( (*it).second.size() > 10 ) {
-          processedRead = d->condenseGroup( (*it).second );
-        }
-        else {
-          processedRead = (*it).second.front()->newClone() ;
-        }
+void dmx::largestFirstFunctor::operator() ( const blocked_range< size_t > & r ) const {
+  dmxReadSerialVector group;
+  size_t n = refs->size();
+  for ( size_t w = r.begin(); w != r.end(); ++w ) {
+    for ( ;; ) {
+      // one claim is a clustered group, or a block of small ones after them
+      size_t claim = next->fetch_and_increment();
+      size_t begin, end;
+      if ( claim < clustered ) {
+        begin = claim;
+        end = claim + 1;
+      }
+      else {
+        begin = clustered + ( claim - clustered ) * smallGroupBlock;
+        end = std::min( n, begin + smallGroupBlock );
+      }
+      if ( begin >= n ) {
+        break;
+      }
+      for ( size_t g = begin; g < end; ++g ) {
+        const groupRef & ref = (*refs)[ g ];
+        group.assign( ref.reads, ref.reads + ref.size );
+        d->reduceGroup( group, drpq );
       }
-    }
-    else {
-      processedRead = r->front()->newClone();
-    }
-
-    processedRead->setGroupSize( r->size() );
-    //std::cout << &it << " numclusters: " << clusterMap.size() << " groupSize: " << r->size() << " clusterSize: " << (*it).second.size() << std::endl;
-    drpq->push( processedRead );
-    for ( dmxReadSerialVector::iterator i = r->begin(); i != r->end(); ++i ) {
-      delete (*i);
-      (*i) = NULL;
     }
   }
-  r->clear();
 }
 
+void dmx::reduceGroup( dmxReadSerialVector & group, dmxReadStore * drpq, bool copyReads ) {
+  if ( group.empty() ) {
+    return;
+  }
+  tick_count start = tick_count::now();
+  size_t groupSize = group.size();
+  dmxReadKey groupKey = group.front()->key;
+  dmxReadSerialVector & results = drpq->reads.local();
+  dmxArena & arena = drpq->arena();
+  size_t resultsBefore = results.size();
+
+  // TODO randomly select from vector when below size
+  if ( group.size() > minClusteredGroup ) {
+    std::map< int, dmxReadSerialVector > clusterMap;
+    getClusters( clusterMap, &group );
 
+    // one representative per cluster
+    for ( std::map< int, dmxReadSerialVector >::iterator it = clusterMap.begin(); it != clusterMap.end(); ++it ) {
+      dmxRead * processedRead;
+      if ( (*it).second.size() > 10 ) {
+        processedRead = condenseGroup( (*it).second, arena );
+      }
+      else {
+        dmxRead * front = (*it).second.front();
+        processedRead = copyReads ? front->newCopy( arena ) : front->newClone( arena );
+      }
+      processedRead->setClusterSize( (*it).second.size() );
+      results.push_back( processedRead );
+    }
+  }
+  if ( results.size() == resultsBefore ) {
+    results.push_back( copyReads ? group.front()->newCopy( arena ) : group.front()->newClone( arena ) );
+  }
+  for ( size_t i = resultsBefore; i < results.size(); ++i ) {
+    results[ i ]->setGroupSize( group.size() );
+  }
 
+  group.clear();
+  reduceTimes.local().add( ( tick_count::now() - start ).seconds(), groupSize, groupKey );
+}
 
 void dmx::getClusters( std::map< int, dmxReadSerialVector > & clusterMap, dmxReadSerialVector * rv ) {
   // clusters reads then loads cluster membership into map passed as reference
-  std::vector< double > groupKmers, readKmers;
+  if ( clusteringKind == SKETCH_CLUSTERING ) {
+    getSketchClusters( clusterMap, rv );
+  }
+  else {
+    getDBScanClusters( clusterMap, rv );
+  }
+}
 
-  for ( dmxReadSerialVector::iterator it = rv->begin(); it != rv->end(); ++it ) {
-    (*it)->getDinucleotideFreqs( readKmers );
-    groupKmers.insert( groupKmers.end(), readKmers.begin(), readKmers.end() );
-    readKmers.clear();
+void dmx::getSketchClusters( std::map< int, dmxReadSerialVector > & clusterMap, dmxReadSerialVector * rv ) {
+  std::vector< int > clusters;
+  sketcher.cluster( *rv, clusters );
+  for ( size_t i = 0; i < rv->size(); ++i ) {
+    clusterMap[ clusters[ i ] ].push_back( (*rv)[ i ] );
+  }
+}
+
+void dmx::getDBScanClusters( std::map< int, dmxReadSerialVector > & clusterMap, dmxReadSerialVector * rv ) {
+#ifdef DMX_HAVE_LTILIB
+  // each read's k-mer profile is one row of the matrix
+  int width = dmxRead::kmerProfileSize( kmerLength );
+  lti::matrix<double> groupKmerMatrix( rv->size(), width );
+  for ( size_t i = 0; i < rv->size(); ++i ) {
+    (*rv)[ i ]->getKmerProfile( kmerLength, &groupKmerMatrix.at( i, 0 ) );
   }
-  double * groupKmerArray = &groupKmers[0];
-  lti::matrix<double> groupKmerMatrix( rv->size(), 32, groupKmerArray );
 
   typedef lti::l2Distantor< lti::vector< double > > distanceType;
   lti::DBScan< distanceType >::parameters clusteringParameters;
@@ -514,63 +1068,138 @@ void dmx::getClusters( std::map< int, dmxReadSerialVector > & clusterMap, dmxRea
     }
     i++;
   }
+#endif
 }
 
-dmxRead * dmx::condenseGroup( std::vector< dmxRead * > & rv ) {
+void dmx::msaAlignment( const std::vector< std::string > & seqs, std::string & matrix ) {
   typedef String< Dna5 > TSequence;
-  StringSet< TSequence > fSeq;
-  StringSet< TSequence > rSeq;
+  StringSet< TSequence > seqSet;
+  for ( size_t i = 0; i < seqs.size(); ++i ) {
+    appendValue( seqSet, seqs[ i ] );
+  }
+  Graph< Alignment< StringSet< TSequence, Dependent<> > > > aliG( seqSet );
+  globalMsaAlignment( aliG, Score<int>(0, -1, -1, -2) );
+  convertAlignment( aliG, matrix );
+}
 
+dmxRead * dmx::condenseGroup( std::vector< dmxRead * > & rv, dmxArena & arena ) {
+  std::vector< std::string > fSeqs, rSeqs, fQuals, rQuals;
   for ( std::vector< dmxRead * >::iterator i = rv.begin(); i != rv.end(); ++i ) {
-    appendValue( fSeq, (*i)->fSeq );
-    appendValue( rSeq, (*i)->rSeq );
+    fSeqs.push_back( (*i)->fSeq.str() );
+    rSeqs.push_back( (*i)->rSeq.str() );
+    fQuals.push_back( (*i)->fQual.str() );
+    rQuals.push_back( (*i)->rQual.str() );
   }
 
-  Graph< Alignment< StringSet< TSequence, Dependent<> > > > fAliG( fSeq );
-  Graph< Alignment< StringSet< TSequence, Dependent<> > > > rAliG( rSeq );
-
-  globalMsaAlignment( fAliG, Score<int>(0, -1, -1, -2) );
-  globalMsaAlignment( rAliG, Score<int>(0, -1, -1, -2) );
-
   std::string fMatrix;
   std::string rMatrix;
 
-  convertAlignment( fAliG, fMatrix );
-  convertAlignment( rAliG, rMatrix );
+  if ( consensusKind == STAR_CONSENSUS ) {
+    starAligner.align( fSeqs, fMatrix );
+    starAligner.align( rSeqs, rMatrix );
+  }
+  else {
+    msaAlignment( fSeqs, fMatrix );
+    msaAlignment( rSeqs, rMatrix );
+  }
 
-  std::string fCon = computeConsensus( fMatrix, rv.size() );
-  std::string rCon = computeConsensus( rMatrix, rv.size() );
+  std::string fQual, rQual;
+  std::vector< unsigned > fSupport, rSupport;
+  std::string fCon = computeConsensus( fMatrix, rv.size(), fQuals, fQual, fSupport );
+  std::string rCon = computeConsensus( rMatrix, rv.size(), rQuals, rQual, rSupport );
 
   // TODO modify dmxRead struct to record consensus info (reads that go into consensus, etc.)... halfway done...
-  dmxRead * r = new dmxRead( rv.front()->getDescriptionCode(), rv.front()->tag, rv.front()->get_readID() ); 
-  r->fwd( rv.front()->getFwdBCidx(), fCon );
-  r->rev( rv.front()->getRevBCidx(), rCon );
+  dmxRead * r = dmxRead::create( arena, rv.front()->getDescriptionCode(), rv.front()->key, rv.front()->get_readID() ); 
+  r->fwd( rv.front()->getFwdBCidx(), fCon, fQual, 0, arena, compactReads );
+  r->rev( rv.front()->getRevBCidx(), rCon, rQual, 0, arena, compactReads );
+  r->setSupport( fSupport, rSupport, arena );
   r->setClusterSize( rv.size() ); 
   return r;
 }
 
-std::string dmx::computeConsensus( std::string & matrix, size_t nrow ) {
-  size_t skip = matrix.size() / nrow;
-  std::string consensus = "";
+namespace {
 
-  std::map< char, int > baseCount;
-  std::map< int, char > countBase;
-  
-  for ( size_t i = 0; i < skip; ++i ) {
+  // the tally slots of a column
+  enum { SLOT_A, SLOT_C, SLOT_G, SLOT_T, SLOT_N, SLOT_GAP, consensusSlots };
+  const char slotSymbols[ consensusSlots ] = { 'A', 'C', 'G', 'T', 'N', '-' };
+  const int maxConsensusQuality = 41;
+}
 
-    baseCount.clear();
-    countBase.clear();
-    
-    for ( size_t j = nrow - 1; j != 0; --j ) {
-      size_t index = ( j * skip ) + i;
-      baseCount[ matrix.at( index ) ]++;
-      countBase.insert( std::pair< int, char >( baseCount[ matrix.at( index ) ], matrix.at( index ) ) );
+std::string dmx::computeConsensus( const std::string & matrix, size_t nrow, const std::vector< std::string > & quals,
+    std::string & quality, std::vector< unsigned > & support ) {
+  std::string consensus;
+  quality.clear();
+  support.clear();
+  if ( nrow == 0 ) {
+    return consensus;
+  }
+  size_t ncol = matrix.size() / nrow;
+
+  // one plane of counts and one of summed qualities per slot, so that each
+  // row adds to runs of consecutive columns
+  std::vector< unsigned > count( consensusSlots * ncol, 0 );
+  std::vector< float > weight( consensusSlots * ncol, 0.0f );
+  std::vector< float > rowWeight( ncol );
+  for ( size_t r = 0; r < nrow; ++r ) {
+    const char * row = &matrix[ r * ncol ];
+    const std::string & q = quals[ r ];
+
+    // the quality of each base in the row; a gap takes the lower of the
+    // qualities of the bases either side of it
+    size_t b = 0;
+    float before = -1.0f;
+    for ( size_t c = 0; c < ncol; ++c ) {
+      if ( row[ c ] != '-' ) {
+        before = b < q.size() ? (float) ( q[ b ] - 33 ) : 0.0f;
+        ++b;
+      }
+      rowWeight[ c ] = before;
+    }
+    float after = -1.0f;
+    for ( size_t c = ncol; c-- > 0; ) {
+      if ( row[ c ] != '-' ) {
+        after = rowWeight[ c ];
+      }
+      else if ( rowWeight[ c ] < 0.0f || ( after >= 0.0f && after < rowWeight[ c ] ) ) {
+        rowWeight[ c ] = after < 0.0f ? 0.0f : after;
+      }
     }
- 
-    if ( ( * ( countBase.rbegin() ) ).second != '-' ) {
-      consensus.push_back( ( * ( countBase.rbegin() ) ).second );
+
+    for ( int s = 0; s < consensusSlots; ++s ) {
+      unsigned * counts = &count[ s * ncol ];
+      float * weights = &weight[ s * ncol ];
+      const char symbol = slotSymbols[ s ];
+      for ( size_t c = 0; c < ncol; ++c ) {
+        bool hit = row[ c ] == symbol;
+        counts[ c ] += hit;
+        weights[ c ] += hit ? rowWeight[ c ] : 0.0f;
+      }
     }
+  }
 
+  // votes are counts, or qualities with qualityVotes; the consensus quality
+  // is the quality for the winner less that against it
+  for ( size_t c = 0; c < ncol; ++c ) {
+    int best = 0;
+    float bestVote = -1.0f;
+    float total = 0.0f;
+    for ( int s = 0; s < consensusSlots; ++s ) {
+      float vote = qualityVotes ? weight[ s * ncol + c ] : (float) count[ s * ncol + c ];
+      if ( vote > bestVote ) {
+        bestVote = vote;
+        best = s;
+      }
+      total += weight[ s * ncol + c ];
+    }
+    if ( best == SLOT_GAP ) {
+      continue;
+    }
+    float winning = weight[ best * ncol + c ];
+    int q = (int) ( winning - ( total - winning ) + 0.5f );
+    q = std::max( 0, std::min( maxConsensusQuality, q ) );
+    consensus.push_back( slotSymbols[ best ] );
+    quality.push_back( (char) ( 33 + q ) );
+    support.push_back( count[ best * ncol + c ] );
   }
   return consensus;
 }
@@ -587,114 +1216,172 @@ void dmx::printBarcodeResults( concurrent_vector< dmxRead * > resultVector ) {
   }
 }
 
-void dmx::printBarcodeResults( dmxReadPriQ &resultVector ) {
-  dmxRead * read;
-  while (resultVector.try_pop(read)) {
-    read->print();
+void dmx::printBarcodeResults( dmxReadSerialVector & resultVector ) {
+  for ( dmxReadSerialVector::iterator i = resultVector.begin(); i != resultVector.end(); ++i ) {
+    (*i)->print();
   }
 }
 
 void dmx::printConcordantBarcodeResults() {
-  printBarcodeResults( conBarcode );
+  printBarcodeResults( conBarcodeSerVec );
 }
 
 void dmx::printFwdOnlyBarcodeResults() {
-  printBarcodeResults( fwdBarcode );
+  printBarcodeResults( fwdBarcodeSerVec );
 }
 
 void dmx::printRevOnlyBarcodeResults() {
-  printBarcodeResults( revBarcode );
+  printBarcodeResults( revBarcodeSerVec );
 }
 
 void dmx::printDiscordantBarcodeResults() {
-  printBarcodeResults( disBarcode );
+  printBarcodeResults( disBarcodeSerVec );
 }
 
 void dmx::printUnidentifiableBarcodeResults() {
-  printBarcodeResults( nonBarcode );
+  printBarcodeResults( nonBarcodeSerVec );
 }
 
-void dmx::printFasta( dmxReadSerialVector drv, std::ofstream & fh ) {
-  for ( unsigned i = 0; i < drv.size(); ++i ) {
-    drv[ i ]->printFasta( i, fh );
-  }
-}
+namespace {
 
-void dmx::printFastq( dmxReadSerialVector drv, std::ofstream & fh ) {
-  for ( unsigned i = 0; i < drv.size(); ++i ) {
-    drv[ i ]->printFastq( i, fh );
-  }
-}
+  // one batch of records, formatted (and compressed, into packed) by a
+  // worker and written by the sink
+  struct writeBatch {
+    size_t begin, end;
+    std::string bytes, packed;
+  };
 
-void dmx::printFasta( dmxReadSerialVector drv, std::ofstream & fh, int barcode_index ) {
-  for ( unsigned i = 0; i < drv.size(); ++i ) {
-    if ( drv[ i ]->getFwdBCidx() == barcode_index ) {
-      drv[ i ]->printFFasta( i, fh );
-    }
-    if ( drv[ i ]->getRevBCidx() == barcode_index ) {
-      drv[ i ]->printRFasta( i, fh );
+  struct writeJob {
+    dmxReadSerialVector * drv;
+    dmx::outputFormat format;
+    int barcodeIndex;
+    dmxWriter * writer;
+    size_t next, step;
+    // batches go back here once written, so their buffers are reused
+    concurrent_queue< writeBatch * > spare;
+  };
+
+  struct writeSourceFilter {
+    writeJob * job;
+    writeBatch * operator()( flow_control & fc ) const {
+      if ( job->next == job->drv->size() ) {
+        fc.stop();
+        return NULL;
+      }
+      writeBatch * batch;
+      if ( !job->spare.try_pop( batch ) ) {
+        batch = new writeBatch();
+      }
+      batch->begin = job->next;
+      batch->end = std::min( job->drv->size(), job->next + job->step );
+      job->next = batch->end;
+      return batch;
     }
-  }
-}
+  };
 
-void dmx::printFastq( dmxReadSerialVector drv, std::ofstream & fh, int barcode_index ) {
-  for ( unsigned i = 0; i < drv.size(); ++i ) {
-    if ( drv[ i ]->getFwdBCidx() == barcode_index ) {
-      drv[ i ]->printFFastq( i, fh );
+  struct formatFilter {
+    writeJob * job;
+    writeBatch * operator()( writeBatch * batch ) const {
+      std::string & out = batch->bytes;
+      out.clear();
+      dmxReadSerialVector & drv = *job->drv;
+      int b = job->barcodeIndex;
+      bool fasta = job->format == dmx::FASTA_OUTPUT;
+      for ( size_t i = batch->begin; i < batch->end; ++i ) {
+        dmxRead * r = drv[ i ];
+        if ( b < 0 || r->getFwdBCidx() == b ) {
+          fasta ? r->formatFFasta( i, out ) : r->formatFFastq( i, out );
+        }
+        if ( b < 0 || r->getRevBCidx() == b ) {
+          fasta ? r->formatRFasta( i, out ) : r->formatRFastq( i, out );
+        }
+      }
+      if ( job->writer->compressed() ) {
+        job->writer->compress( out, batch->packed );
+      }
+      return batch;
     }
-    if ( drv[ i ]->getRevBCidx() == barcode_index ) {
-      drv[ i ]->printRFastq( i, fh );
+  };
+
+  struct writeSinkFilter {
+    writeJob * job;
+    void operator()( writeBatch * batch ) const {
+      job->writer->write( job->writer->compressed() ? batch->packed : batch->bytes );
+      job->spare.push( batch );
     }
-  }
+  };
 }
 
-void dmx::printFasta( dmxReadPriQ & drq, std::ofstream & fh ) {
-  dmxRead * read;
-  unsigned i = 0;
-  while ( drq.try_pop(read) ) {
-    read->printFasta( i, fh );
-    ++i;
+void dmx::writeReads( dmxReadSerialVector & drv, dmxWriter & w, outputFormat format, int barcode_index ) {
+  if ( drv.empty() ) {
+    return;
+  }
+  writeJob job;
+  job.drv = &drv;
+  job.format = format;
+  job.barcodeIndex = barcode_index;
+  job.writer = &w;
+  job.next = 0;
+  // enough reads per batch to fill about batchBytes, judged by the first
+  size_t recordBytes = 2 * ( drv[ 0 ]->fSeq.size() + drv[ 0 ]->rSeq.size() ) + 256;
+  job.step = std::max( (size_t) 1, dmxWriter::batchBytes / recordBytes );
+
+  writeSourceFilter source;
+  source.job = &job;
+  formatFilter formatter;
+  formatter.job = &job;
+  writeSinkFilter sink;
+  sink.job = &job;
+
+  parallel_pipeline( maxTokens,
+      make_filter< void, writeBatch * >( filter::serial_in_order, source ) &
+      make_filter< writeBatch *, writeBatch * >( filter::parallel, formatter ) &
+      make_filter< writeBatch *, void >( filter::serial_in_order, sink ) );
+
+  writeBatch * batch;
+  while ( job.spare.try_pop( batch ) ) {
+    delete batch;
   }
 }
 
-void dmx::printFasta( dmxReadPriQ & drq, std::ofstream & fh, int barcode_index ) {
-  dmxRead * read;
-  unsigned i = 0;
-  while ( drq.try_pop(read) ) {
-    if ( read->getFwdBCidx() == barcode_index ) {
-      read->printFFasta( i, fh );
-    }
-    if ( read->getRevBCidx() == barcode_index ) {
-      read->printRFasta( i, fh );
-    }
-    ++i;
-  }
+std::string dmx::outputName( const std::string & base ) {
+  return base + dmxWriter::suffix( outputCompression );
 }
 
 void dmx::printGoodFasta( std::string goodFastaOutfile ) {
-  std::ofstream fh ( goodFastaOutfile.c_str() );
-  printFasta( conBarcodeSerVec, fh );
-  printFasta( fwdBarcodeSerVec, fh );
-  printFasta( revBarcodeSerVec, fh );
-  fh.close();
+  dmxWriter w( outputName( goodFastaOutfile ), outputCompression );
+  writeReads( conBarcodeSerVec, w, FASTA_OUTPUT );
+  writeReads( fwdBarcodeSerVec, w, FASTA_OUTPUT );
+  writeReads( revBarcodeSerVec, w, FASTA_OUTPUT );
+  w.close();
 }
 
 void dmx::printGoodFastq( std::string goodFastqOutfile ) {
-  std::ofstream fh ( goodFastqOutfile.c_str() );
-  printFastq( conBarcodeSerVec, fh );
-  printFastq( fwdBarcodeSerVec, fh );
-  printFastq( revBarcodeSerVec, fh );
-  fh.close();
+  dmxWriter w( outputName( goodFastqOutfile ), outputCompression );
+  writeReads( conBarcodeSerVec, w, FASTQ_OUTPUT );
+  writeReads( fwdBarcodeSerVec, w, FASTQ_OUTPUT );
+  writeReads( revBarcodeSerVec, w, FASTQ_OUTPUT );
+  w.close();
 }
 
 void dmx::printAllFasta( std::string goodFastaOutfile ) {
-  std::ofstream fh ( goodFastaOutfile.c_str() );
-  printFasta( conBarcodeSerVec, fh );
-  printFasta( fwdBarcodeSerVec, fh );
-  printFasta( revBarcodeSerVec, fh );
-  printFasta( disBarcode, fh );
-  printFasta( nonBarcode, fh );
-  fh.close();
+  dmxWriter w( outputName( goodFastaOutfile ), outputCompression );
+  writeReads( conBarcodeSerVec, w, FASTA_OUTPUT );
+  writeReads( fwdBarcodeSerVec, w, FASTA_OUTPUT );
+  writeReads( revBarcodeSerVec, w, FASTA_OUTPUT );
+  writeReads( disBarcodeSerVec, w, FASTA_OUTPUT );
+  writeReads( nonBarcodeSerVec, w, FASTA_OUTPUT );
+  w.close();
+}
+
+void dmx::printPerBarcodeFasta( std::string outfilePrefix ) {
+  for ( size_t i = 0; i < barcodeNames.size(); ++i ) {
+    dmxWriter w( outputName( outfilePrefix + "." + barcodeNames[ i ] + ".fasta" ), outputCompression );
+    writeReads( conBarcodeSerVec, w, FASTA_OUTPUT, i );
+    writeReads( fwdBarcodeSerVec, w, FASTA_OUTPUT, i );
+    writeReads( revBarcodeSerVec, w, FASTA_OUTPUT, i );
+    w.close();
+  }
 }
 
 
@@ -837,10 +1524,14 @@ void dmx::test_consensus() {
     convertAlignment( aliG, matrix );
     std::cout << aliG << std::endl;
     std::cout << matrix << std::endl;
-    std::cout << computeConsensus( matrix, 5 ) << std::endl;
+    std::vector< std::string > quals( 5, std::string( 10, 'J' ) );
+    std::string quality;
+    std::vector< unsigned > support;
+    std::cout << computeConsensus( matrix, 5, quals, quality, support ) << std::endl;
 }
 
 void dmx::cluster_test() {
+#ifdef DMX_HAVE_LTILIB
 
   using namespace lti;
 
@@ -879,6 +1570,7 @@ void dmx::cluster_test() {
 
   std::cerr << clusteringResult << std::endl;
 
+#endif
 }
 
 
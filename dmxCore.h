@@ -51,9 +51,12 @@
 #include <tbb/tbb.h>
 #include <tbb/concurrent_vector.h>
 #include <tbb/concurrent_queue.h>
-#include <tbb/parallel_do.h>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_sort.h>
-#include <tbb/concurrent_priority_queue.h>
+#include <tbb/concurrent_hash_map.h>
+#include <tbb/pipeline.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/enumerable_thread_specific.h>
 
 #include <utility>
 #include <iostream>
@@ -61,15 +64,26 @@
 #include <string>
 #include <map>
 
+#include "dmxArena.h"
 #include "dmxBarcode.h"
+#include "dmxConsensus.h"
 #include "dmxIO.h"
+#include "dmxMatcher.h"
+#include "dmxMyers.h"
 #include "dmxRead.h"
+#include "dmxSink.h"
+#include "dmxSketch.h"
+#include "dmxSpill.h"
+#include "dmxView.h"
+#include "dmxWriter.h"
 
+#ifdef DMX_HAVE_LTILIB
 #include <ltiClustering.h>
 #include <ltiL2Distance.h>
 #include <ltiKMeansClustering.h>
 #include <ltiDBScan.h>
 #include <ltiAdaptiveKMeans.h>
+#endif
 
 using namespace seqan;
 using namespace tbb;
@@ -79,25 +93,62 @@ using namespace tbb;
   
 
 struct fastqPair {
-  std::string id1, id2, sq1, sq2, ql1, ql2;
+  dmxView id1, id2, sq1, sq2, ql1, ql2;
   unsigned num;
 
 
 };
 
-struct dmxMatch {
-  unsigned min;
-  int index;
+/*
+ * A batch of read pairs handed from the reader to digest.  Chunks are
+ * recycled, so pairs may hold more entries than the count in use.  The pairs
+ * point into the input blocks, which the chunk holds a reference to until it
+ * has been digested.
+ */
+struct fastqChunk {
+  std::vector< fastqPair > pairs;
+  size_t count;
+  std::vector< dmxBlock * > blocks;
+
+  fastqChunk() : count( 0 ) { }
+
+  // called once for each block the pairs point into
+  void retainBlock( dmxBlock * block ) {
+    if ( block != NULL ) {
+      block->retain();
+      blocks.push_back( block );
+    }
+  }
+  void releaseBlocks() {
+    for ( size_t i = 0; i < blocks.size(); ++i ) {
+      blocks[ i ]->release();
+    }
+    blocks.clear();
+  }
 };
 
 typedef concurrent_vector< dmxRead * > dmxReadVector; 
-typedef concurrent_priority_queue< dmxRead *, dmxReadCompare > dmxReadPriQ; 
 typedef std::vector< dmxRead * > dmxReadSerialVector; 
-
-
-typedef StringSet< String< char > > barcodeStringSetType;
-typedef Index< StringSet< String< char > > > barcodeStringSetIndexType;
-typedef Finder< Index< StringSet< String< char > > > > barcodeStringSetIndexFinderType;
+// one vector per thread, so digest workers append without contention
+typedef enumerable_thread_specific< dmxReadSerialVector > dmxReadLocalVectors; 
+// reads grouped by key as they are digested, for --grouping hash
+typedef concurrent_hash_map< dmxReadKey, dmxReadSerialVector, dmxReadKeyHashCompare > dmxReadGroupMap;
+typedef enumerable_thread_specific< dmxArena > dmxLocalArenas;
+
+/*
+ * The reads of one category: per-thread vectors of reads, and per-thread
+ * arenas holding the reads themselves, freed together by release().
+ */
+struct dmxReadStore {
+  dmxReadLocalVectors reads;
+  dmxLocalArenas arenas;
+
+  dmxArena & arena() { return arenas.local(); }
+  dmxRead * newRead( barcodeAssignmentType code, const dmxReadKey & key, unsigned readID ) {
+    return dmxRead::create( arenas.local(), code, key, readID );
+  }
+  void release();
+};
 
 
 class dmx {
@@ -107,17 +158,26 @@ class dmx {
 
     dmx( char* barcodeFile );
     void initFastq( unsigned _maxDistance, unsigned _chunkSize, unsigned _trimSize );
+    void initPipeline( int _numThreads, unsigned _maxInflightChunks, unsigned _memoryBudget );
+    void initMatcher( const std::string & matcherName, unsigned maxShift );
+    void initGrouping( const std::string & groupingName );
+    void initStorage( bool compact );
+    void initOutput( const std::string & compressionName );
+    void initStream( const std::string & outputPrefix );
+    void initSpill( unsigned megabytes, const std::string & outputPrefix );
+    void initClustering( const std::string & clusteringName, unsigned kmer );
+    void initConsensus( const std::string & consensusName, bool _qualityVotes );
     void runFastq( char* pair1FileName, char* pair2FileName );
     
     unsigned readCount; 
     unsigned maxDistance;
-    void digest();
-    void digest(barcodeStringSetIndexFinderType * _barcodeFinder, std::vector< fastqPair > * fastqFeedChunk);
+    void digest( fastqChunk * fastqFeedChunk );
+    void matchMates( const std::vector< dmxView > & seqs, std::vector< dmxMatch > & matches );
 
     void parallelDigest2();
 
     void printBarcodeResults( dmxReadVector resultVector );
-    void printBarcodeResults( dmxReadPriQ &resultVector );
+    void printBarcodeResults( dmxReadSerialVector & resultVector );
 
     void printConcordantBarcodeResults();
     void printFwdOnlyBarcodeResults();
@@ -125,15 +185,15 @@ class dmx {
     void printDiscordantBarcodeResults();
     void printUnidentifiableBarcodeResults();
 
-    void printFasta( dmxReadSerialVector, std::ofstream & fh );
-    void printFastq( dmxReadSerialVector, std::ofstream & fh );
-
-    void printFastq( dmxReadSerialVector, std::ofstream & fh, int barcode_index );
+    // records are formatted in parallel batches and written in order; with a
+    // barcode index only the mates carrying that barcode are written
+    enum outputFormat { FASTA_OUTPUT, FASTQ_OUTPUT };
+    void writeReads( dmxReadSerialVector & drv, dmxWriter & w, outputFormat format, int barcode_index = -1 );
 
-    void printFasta( dmxReadSerialVector, std::ofstream & fh, int barcode_index );
-
-    void printFasta( dmxReadPriQ&, std::ofstream & fh );
-    void printFasta( dmxReadPriQ&, std::ofstream & fh, int barcode_index );
+    // output files are compressed by the format workers
+    dmxWriter::compressionType outputCompression;
+    // base with the extension of the output compression
+    std::string outputName( const std::string & base );
 
     void printGoodFasta( std::string filename );
     void printGoodFastq( std::string filename );
@@ -142,6 +202,11 @@ class dmx {
 
     void printPerBarcodeFasta( std::string outfilePrefix );
 
+    // when streaming, digest writes each pair straight to the file of its
+    // barcode (or the unassigned file) and nothing is held for groupReduce
+    bool streaming;
+    dmxSinkSet streamSinks;
+
     unsigned chunkSize, trimSize; 
     unsigned int distance(const std::string s1, const std::string s2);
     void read2FilePairedFastq( char * pair1FileName, char * pair2FileName );
@@ -150,23 +215,42 @@ class dmx {
     dmxMatch getMatch(std::string seq);
     dmxMatch getExactMatch(std::string seq);
     dmxMatch getMatchMyersInfix(std::string seq);
-    dmxMatch getMatchIndexFinder(std::string seq,  barcodeStringSetIndexFinderType * _barcodeFinder);
 
     bool pairedEnd;
-    atomic< bool > finishedReading;
-    atomic< bool > spoon;
+
+    // worker threads (task_scheduler_init::automatic for all cores) and the
+    // number of chunks digest works on at once
+    int numThreads;
+    size_t maxTokens;
+
+    // at most chunkLimit chunks exist at any time; with a memory budget (in
+    // bytes) the limit is lowered once the size of a chunk is known
+    size_t chunkLimit;
+    size_t memoryBudget;
+    size_t allocatedChunks;
 
     MultiSeqFile pair1File;
     MultiSeqFile pair2File;
 
     std::map< std::string, barcode > barcodes;
     std::vector< std::string > barcodeNames;
-
-    dmxReadPriQ fwdBarcode;
-    dmxReadPriQ revBarcode;
-    dmxReadPriQ conBarcode;
-    dmxReadPriQ disBarcode;
-    dmxReadPriQ nonBarcode;
+    std::vector< barcode * > barcodeList;
+
+    dmxReadStore fwdBarcode;
+    dmxReadStore revBarcode;
+    dmxReadStore conBarcode;
+    dmxReadStore disBarcode;
+    dmxReadStore nonBarcode;
+    // held reads keep 2-bit bases and binned qualities
+    bool compactReads;
+
+    // sort groups runs of equal keys after digest; hash groups during it
+    enum groupingType { SORT_GROUPING, HASH_GROUPING };
+    groupingType groupingKind;
+    dmxReadGroupMap fwdGroups;
+    dmxReadGroupMap revGroups;
+    dmxReadGroupMap conGroups;
+    void addGroupedRead( dmxReadStore & store, dmxReadGroupMap & groups, dmxRead * read );
 
     dmxReadSerialVector fwdBarcodeSerVec;
     dmxReadSerialVector revBarcodeSerVec;
@@ -174,74 +258,169 @@ class dmx {
     dmxReadSerialVector disBarcodeSerVec;
     dmxReadSerialVector nonBarcodeSerVec;
 
-    void convertPriorityQueueToVector( dmxReadPriQ & q, dmxReadSerialVector & v );
-    void convertPriorityQueuesToVectors();
-
-    concurrent_queue< std::vector< fastqPair > * > fastqChunks;
-    concurrent_vector< std::vector< fastqPair > * > fastqFeed;
-
-    barcodeStringSetType barcodeStringSet;
-    barcodeStringSetIndexType barcodeStringSetIndex;
-    barcodeStringSetIndexFinderType barcodeFinder;
+    // moves the per-thread reads of a category into one vector, sorted
+    void gatherResults( dmxReadLocalVectors & locals, dmxReadSerialVector & v );
+
+    // frees every read of every category once they have been written
+    void releaseReads();
+
+    // with a spill threshold, once the reads held for grouping take up more
+    // than spillBytes each digest worker writes its reads of each grouped
+    // category out as a sorted run, and groupReduce merges the runs back
+    size_t spillBytes;
+    tbb::atomic< size_t > heldBytes;
+    dmxSpill fwdSpill;
+    dmxSpill revSpill;
+    dmxSpill conSpill;
+    size_t localHeldBytes();
+    // called by a worker after each chunk with what it held before
+    void spillLocalReads( size_t heldBefore );
+    void spillLocal( dmxReadStore & store, dmxSpill & spill );
+    // after digest, what every worker still holds of a category with runs
+    void spillRemainingReads( dmxReadStore & store, dmxSpill & spill );
+
+    // parsed chunks waiting for digest; a NULL chunk marks the end of input
+    concurrent_bounded_queue< fastqChunk * > fastqChunks;
+    // digested chunks waiting to be refilled by the reader
+    concurrent_bounded_queue< fastqChunk * > freeChunks;
+
+    fastqChunk * acquireChunk();
+    size_t chunkBytes( fastqChunk * chunk );
+
+    // barcode lookup shared read-only by the digest workers; the myers
+    // matcher also allows indels but is slower
+    enum matcherType { TABLE_MATCHER, MYERS_MATCHER };
+    matcherType matcherKind;
+    dmxLayoutMatcher matcher;
+    dmxMyersMatcher myersMatcher;
+    // second chance for reads whose barcode is not at its layout position
+    dmxPrimerAnchor anchor;
 
     dmxIO * dmxio;
 
     void cluster_test();
     
     void groupReduce();
-    void groupReduce( dmxReadSerialVector * v, dmxReadPriQ * q );
+    void groupReduce( dmxReadSerialVector * v, dmxReadGroupMap * groups, dmxReadStore * q, dmxSpill * spill );
+    // groups are formed from a merge of the spilled runs, a batch at a time
+    void mergeReduce( dmxSpill * spill, dmxReadStore * q );
+    // condenses one group and adds its representatives to q; with copyReads
+    // they get bytes of their own instead of sharing those of the group
+    void reduceGroup( dmxReadSerialVector & group, dmxReadStore * q, bool copyReads = false );
+
+    struct groupStartFunctor {
+      dmxReadSerialVector * drsv;
+      std::vector< char > * isStart;
+
+      void operator()( const blocked_range< size_t > & r ) const;
+    };
+
+    // groups of more than minClusteredGroup reads are clustered and
+    // condensed, which is where nearly all the time goes, so they are handed
+    // to the workers one at a time, largest first; the rest follow in blocks
+    static const size_t minClusteredGroup = 100;
+    static const size_t smallGroupBlock = 256;
+
+    struct groupRef {
+      dmxRead ** reads;
+      size_t size;
+    };
+
+    struct groupRefLarger {
+      bool operator()( const groupRef & a, const groupRef & b ) const { return a.size > b.size; }
+    };
 
-    struct groupReduceFunctor {
+    struct clusteredGroup {
+      bool operator()( const groupRef & g ) const { return g.size > minClusteredGroup; }
+    };
+
+    struct largestFirstFunctor {
       dmx * d;
-      dmxReadSerialVector * drsv;
-      dmxReadPriQ * drpq;
-      tbb::atomic< bool > * group_reduce_spoon;
-
-      groupReduceFunctor( dmx * _d, dmxReadSerialVector * _drsv, dmxReadPriQ * _drpq, tbb::atomic< bool > * _spoon ) {
-        d = _d;
-        drsv = _drsv;
-        drpq = _drpq;
-        group_reduce_spoon = _spoon;
-      }
+      std::vector< groupRef > * refs;
+      size_t clustered;
+      tbb::atomic< size_t > * next;
+      dmxReadStore * drpq;
 
-      void operator()( dmxReadSerialVector * r, parallel_do_feeder< dmxReadSerialVector * >& feeder ) const;
+      void operator()( const blocked_range< size_t > & r ) const;
     };
 
+    void reduceLargestFirst( std::vector< groupRef > & refs, dmxReadStore * drpq );
+
+    // the time each worker spent in reduceGroup, and its slowest group; a
+    // reduce takes at least as long as its slowest group
+    struct reduceTiming {
+      double work, slowest;
+      size_t groups, slowestSize;
+      dmxReadKey slowestKey;
+
+      reduceTiming() : work( 0 ), slowest( -1 ), groups( 0 ), slowestSize( 0 ) { }
+      void add( double seconds, size_t size, const dmxReadKey & key );
+      void add( const reduceTiming & other );
+    };
+    enumerable_thread_specific< reduceTiming > reduceTimes;
+    void reportGroupReduce( const char * category, double seconds );
+
+    // reads of a group are clustered with DBScan on the counts of their
+    // k-mers (needs ltilib), or by MinHash sketches of longer k-mers
+    enum clusteringType { DBSCAN_CLUSTERING, SKETCH_CLUSTERING };
+    clusteringType clusteringKind;
+    static const unsigned minKmerLength = 2;
+    static const unsigned maxKmerLength = 6;
+    unsigned kmerLength;
+    dmxSketchClusterer sketcher;
     void getClusters( std::map< int, dmxReadSerialVector > & clusterMap, dmxReadSerialVector * rv );
-    dmxRead * condenseGroup( std::vector< dmxRead * > & rv );
+    void getDBScanClusters( std::map< int, dmxReadSerialVector > & clusterMap, dmxReadSerialVector * rv );
+    void getSketchClusters( std::map< int, dmxReadSerialVector > & clusterMap, dmxReadSerialVector * rv );
+    // clusters are condensed to the consensus of a multiple alignment, by
+    // banded star alignment or, for reference, seqan's progressive MSA
+    enum consensusType { STAR_CONSENSUS, MSA_CONSENSUS };
+    consensusType consensusKind;
+    dmxStarAligner starAligner;
+    void msaAlignment( const std::vector< std::string > & seqs, std::string & matrix );
+    dmxRead * condenseGroup( std::vector< dmxRead * > & rv, dmxArena & arena );
     void test_consensus();
-    std::string computeConsensus( std::string & matrix, size_t nrow );
+    // the base of each column that most rows have, or with qualityVotes the
+    // one with the highest summed quality, unless it is a gap; its quality
+    // (the summed quality for it less that against it, capped at 41) and
+    // the number of rows that have it.  quals holds the base qualities of
+    // each row's read
+    bool qualityVotes;
+    std::string computeConsensus( const std::string & matrix, size_t nrow, const std::vector< std::string > & quals,
+        std::string & quality, std::vector< unsigned > & support );
   };
 
-  struct digestFunctor2 {
+  /*
+   * Stages of the digest pipeline: take the next parsed chunk (serial),
+   * match and classify its reads (parallel), and return it to the reader
+   * for reuse (serial).
+   */
+  struct chunkSourceFilter {
+    dmx * d;
+    fastqChunk * operator()( flow_control & fc ) const {
+      fastqChunk * chunk;
+      d->fastqChunks.pop( chunk );
+      if ( chunk == NULL ) {
+        fc.stop();
+      }
+      return chunk;
+    }
+  };
 
-    typedef std::vector< fastqPair > * argument_type;
+  struct digestFilter {
+    dmx * d;
+    fastqChunk * operator()( fastqChunk * chunk ) const {
+      d->digest( chunk ); 
+      return chunk;
+    }
+  };
 
+  struct chunkSinkFilter {
     dmx * d;
-    void operator()( argument_type at, parallel_do_feeder< argument_type >& feeder ) const {
-
-    barcodeStringSetIndexFinderType _barcodeFinder( d->barcodeFinder );
-   
-    if ( d->spoon.compare_and_swap( false, true ) ) {
-      // I have the spoon, so I must be the feeder; following loop only entered by the feeder:
-      while ( !(d->finishedReading) ) {
-        int numChunks = d->fastqChunks.unsafe_size();
-        for ( int i = 0; i < numChunks; ++i ) {
-          std::vector< fastqPair > * chunk;
-          if ( d->fastqChunks.try_pop( chunk ) ) {
-            feeder.add( chunk );
-          }
-        }
-        // check safe for concurrent use; compact the internal representation of the concurrent vector
-        d->fastqFeed.shrink_to_fit();
-      }
+    void operator()( fastqChunk * chunk ) const {
+      chunk->releaseBlocks();
+      d->freeChunks.push( chunk );
     }
-    // executed by all tasks, including, eventually, the feeder:
-    d->digest( & _barcodeFinder, at ); 
-    at->clear();
-    delete at;
-  }
-};
+  };
 
 
 #endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXCORE_H_
@@ -0,0 +1,358 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxFastq.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <tbb/tbb.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+  // returns the start of the next line and sets the (CR-stripped) line length,
+  // or NULL if the line is unterminated and more data may follow
+  inline const char * nextLine( const char * p, const char * end, bool atEnd, size_t & length ) {
+    const char * newline = (const char *) memchr( p, '\n', end - p );
+    const char * next;
+    if ( newline == NULL ) {
+      if ( !atEnd || p == end ) {
+        return NULL;
+      }
+      newline = end;
+      next = end;
+    }
+    else {
+      next = newline + 1;
+    }
+    length = newline - p;
+    if ( length > 0 && p[ length - 1 ] == '\r' ) {
+      --length;
+    }
+    return next;
+  }
+
+  inline size_t skipBlankLines( const char * data, size_t pos, size_t length ) {
+    while ( pos < length && ( data[ pos ] == '\n' || data[ pos ] == '\r' ) ) {
+      ++pos;
+    }
+    return pos;
+  }
+
+  // first position at or after pos that is confirmed as a record start, or
+  // length if the block ends before one can be confirmed
+  size_t resync( const char * data, size_t pos, size_t length ) {
+    const char * end = data + length;
+    if ( pos > 0 && data[ pos - 1 ] != '\n' ) {
+      const char * newline = (const char *) memchr( data + pos, '\n', length - pos );
+      if ( newline == NULL ) {
+        return length;
+      }
+      pos = newline - data + 1;
+    }
+    while ( pos < length ) {
+      const char * line2 = (const char *) memchr( data + pos, '\n', length - pos );
+      if ( line2 == NULL ) {
+        return length;
+      }
+      ++line2;
+      if ( data[ pos ] == '@' ) {
+        const char * line3 = (const char *) memchr( line2, '\n', end - line2 );
+        if ( line3 == NULL || line3 + 1 >= end ) {
+          return length;
+        }
+        if ( line3[ 1 ] == '+' ) {
+          return pos;
+        }
+      }
+      pos = line2 - data;
+    }
+    return length;
+  }
+
+  void viewRecord( const fastqRecordView & v, size_t trimSize, dmxBlock * block, fastqRecord & r ) {
+    size_t ts = std::min( trimSize, v.seqLength );
+    size_t tq = std::min( trimSize, v.qualLength );
+    r.id = dmxView( v.header, v.headerLength );
+    r.seq = dmxView( v.seq + ts, v.seqLength - ts );
+    r.qual = dmxView( v.qual + tq, v.qualLength - tq );
+    r.block = block;
+  }
+
+  struct parseRangesFunctor {
+
+    const char * data;
+    size_t length, trimSize;
+    bool atEnd;
+    dmxBlock * block;
+    dmxFastqSplitter::range * ranges;
+
+    void operator()( const tbb::blocked_range< size_t > & r ) const {
+      for ( size_t k = r.begin(); k != r.end(); ++k ) {
+        dmxFastqSplitter::range & rg = ranges[ k ];
+        // the first range starts on a known record boundary
+        size_t pos = ( k == 0 ) ? rg.begin : resync( data, rg.begin, length );
+        pos = skipBlankLines( data, pos, length );
+        rg.first = pos;
+        rg.incomplete = false;
+        rg.malformed = false;
+        rg.records.clear();
+        while ( pos < rg.end ) {
+          fastqRecordView v;
+          const char * next;
+          fastqParseStatus status = parseFastqRecord( data + pos, data + length, atEnd, v, next );
+          if ( status != FASTQ_RECORD ) {
+            rg.incomplete = ( status == FASTQ_INCOMPLETE );
+            rg.malformed = ( status == FASTQ_MALFORMED );
+            break;
+          }
+          rg.records.push_back( fastqRecord() );
+          viewRecord( v, trimSize, block, rg.records.back() );
+          pos = skipBlankLines( data, next - data, length );
+        }
+        rg.last = pos;
+      }
+    }
+  };
+}
+
+fastqParseStatus parseFastqRecord( const char * p, const char * end, bool atEnd, fastqRecordView & r, const char *& next ) {
+  size_t plusLength;
+  const char * plus;
+
+  if ( p == end ) {
+    return FASTQ_INCOMPLETE;
+  }
+  if ( *p != '@' ) {
+    return FASTQ_MALFORMED;
+  }
+  r.header = p;
+  if ( ( r.seq = nextLine( r.header, end, atEnd, r.headerLength ) ) == NULL ) return FASTQ_INCOMPLETE;
+  if ( ( plus = nextLine( r.seq, end, atEnd, r.seqLength ) ) == NULL ) return FASTQ_INCOMPLETE;
+  if ( plus != end && *plus != '+' ) return FASTQ_MALFORMED;
+  if ( ( r.qual = nextLine( plus, end, atEnd, plusLength ) ) == NULL ) return FASTQ_INCOMPLETE;
+  if ( ( next = nextLine( r.qual, end, atEnd, r.qualLength ) ) == NULL ) return FASTQ_INCOMPLETE;
+  if ( plusLength == 0 || r.qualLength != r.seqLength ) return FASTQ_MALFORMED;
+  return FASTQ_RECORD;
+}
+
+////////// dmxFastqSplitter //////////////
+
+dmxFastqSplitter::dmxFastqSplitter( const char * filename, size_t _trimSize, size_t _numRanges ) {
+  fileName = filename;
+  trimSize = _trimSize;
+  numRanges = _numRanges > 0 ? _numRanges : 1;
+  offset = 0;
+  produced = 0;
+}
+
+dmxFastqSplitter::~dmxFastqSplitter() {
+  release( produced );
+}
+
+void dmxFastqSplitter::pin( dmxBlock * block ) {
+  if ( block != NULL ) {
+    pinned p;
+    p.block = block;
+    p.end = produced;
+    pins.push_back( p );
+  }
+}
+
+void dmxFastqSplitter::release( unsigned long long consumed ) {
+  while ( !pins.empty() && pins.front().end <= consumed ) {
+    pins.front().block->release();
+    pins.pop_front();
+  }
+}
+
+void dmxFastqSplitter::malformed( const char * data, const char * where ) {
+  std::cerr << "Error reading " << fileName << ": malformed FASTQ record near byte " << ( offset + ( where - data ) ) << std::endl;
+  std::exit( 1 );
+}
+
+size_t dmxFastqSplitter::parseSerial( dmxBlock * block, const char * data, size_t length, bool atEnd, size_t pos, std::deque< fastqRecord > & out ) {
+  pos = skipBlankLines( data, pos, length );
+  while ( pos < length ) {
+    fastqRecordView v;
+    const char * next;
+    fastqParseStatus status = parseFastqRecord( data + pos, data + length, atEnd, v, next );
+    if ( status == FASTQ_INCOMPLETE && !atEnd ) {
+      break;
+    }
+    if ( status != FASTQ_RECORD ) {
+      malformed( data, data + pos );
+    }
+    out.push_back( fastqRecord() );
+    viewRecord( v, trimSize, block, out.back() );
+    ++produced;
+    pos = skipBlankLines( data, next - data, length );
+  }
+  return pos;
+}
+
+void dmxFastqSplitter::parse( dmxBlock * block, const char * data, size_t length, bool atEnd, std::deque< fastqRecord > & out ) {
+  size_t start = 0;
+
+  if ( !carry.empty() ) {
+    // complete the record carried over from the previous block with however
+    // much of this block comes before the first confirmed record start
+    size_t lineStart = 0;
+    if ( carry[ carry.size() - 1 ] != '\n' ) {
+      const char * newline = length > 0 ? (const char *) memchr( data, '\n', length ) : NULL;
+      lineStart = newline == NULL ? length : newline - data + 1;
+    }
+    start = resync( data, lineStart, length );
+    if ( start == length && !atEnd ) {
+      carry.append( data, length );
+      offset += length;
+      if ( block != NULL ) {
+        block->release();
+      }
+      return;
+    }
+    // the seam records live in a block of their own, freed with the last of them
+    dmxBlock * seam = new dmxBlock();
+    seam->refs = 1;
+    seam->data.reserve( carry.size() + start );
+    seam->data.assign( carry.begin(), carry.end() );
+    seam->data.insert( seam->data.end(), data, data + start );
+    carry.clear();
+    if ( parseSerial( seam, &seam->data[ 0 ], seam->size(), true, 0, out ) != seam->size() ) {
+      malformed( &seam->data[ 0 ], &seam->data[ 0 ] );
+    }
+    pin( seam );
+  }
+
+  if ( length == 0 ) {
+    carry.clear();
+    if ( block != NULL ) {
+      block->release();
+    }
+    return;
+  }
+
+  size_t span = length - start;
+  size_t k = std::min( numRanges, span / minRangeSize );
+  size_t tail;
+
+  if ( k <= 1 ) {
+    tail = parseSerial( block, data, length, atEnd, start, out );
+  }
+  else {
+    ranges.resize( k );
+    for ( size_t i = 0; i < k; ++i ) {
+      ranges[ i ].begin = start + span * i / k;
+      ranges[ i ].end = start + span * ( i + 1 ) / k;
+    }
+    parseRangesFunctor f;
+    f.data = data;
+    f.length = length;
+    f.trimSize = trimSize;
+    f.atEnd = atEnd;
+    f.block = block;
+    f.ranges = &ranges[ 0 ];
+    tbb::parallel_for( tbb::blocked_range< size_t >( 0, k, 1 ), f );
+
+    // every range must pick up exactly where the one before it stopped
+    bool contiguous = true;
+    tail = ranges[ 0 ].first;
+    for ( size_t i = 0; i < k && contiguous; ++i ) {
+      range & rg = ranges[ i ];
+      if ( rg.malformed ) {
+        contiguous = false;
+      }
+      else if ( !rg.records.empty() ) {
+        contiguous = ( rg.first == tail );
+        tail = rg.last;
+      }
+    }
+
+    if ( !contiguous ) {
+      tail = parseSerial( block, data, length, atEnd, start, out );
+    }
+    else {
+      for ( size_t i = 0; i < k; ++i ) {
+        std::deque< fastqRecord > & records = ranges[ i ].records;
+        out.insert( out.end(), records.begin(), records.end() );
+        produced += records.size();
+        records.clear();
+      }
+      if ( atEnd && tail < length ) {
+        tail = parseSerial( block, data, length, atEnd, tail, out );
+      }
+    }
+  }
+
+  carry.assign( data + tail, length - tail );
+  offset += length;
+  pin( block );
+}
+
+////////// dmxMappedFile //////////////
+
+dmxMappedFile::dmxMappedFile( const char * filename ) {
+  begin = NULL;
+  length = 0;
+
+  int fd = open( filename, O_RDONLY );
+  struct stat st;
+  if ( fd < 0 || fstat( fd, &st ) != 0 ) {
+    std::cerr << "Error reading " << filename << ": unable to open" << std::endl;
+    std::exit( 1 );
+  }
+
+  length = st.st_size;
+  if ( length > 0 ) {
+    void * m = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( m == MAP_FAILED ) {
+      std::cerr << "Error reading " << filename << ": unable to map" << std::endl;
+      std::exit( 1 );
+    }
+    madvise( m, length, MADV_SEQUENTIAL );
+    begin = (const char *) m;
+  }
+  close( fd );
+}
+
+dmxMappedFile::~dmxMappedFile() {
+  if ( begin != NULL ) {
+    munmap( (void *) begin, length );
+  }
+}
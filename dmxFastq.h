@@ -0,0 +1,157 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXFASTQ_H_
+#define SANDBOX_JVD_APPS_DMX_DMXFASTQ_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "dmxInflate.h"
+#include "dmxView.h"
+
+/*
+ * Offsets of one FASTQ record inside a buffer owned by someone else.  Nothing
+ * is copied; the view is only valid for as long as that buffer is.
+ */
+struct fastqRecordView {
+  const char * header;
+  const char * seq;
+  const char * qual;
+  size_t headerLength, seqLength, qualLength;
+};
+
+enum fastqParseStatus { FASTQ_RECORD, FASTQ_INCOMPLETE, FASTQ_MALFORMED };
+
+/*
+ * Parses the record starting at p, which must be the start of a header line,
+ * and sets next to the start of the following record.  FASTQ_INCOMPLETE means
+ * the buffer ends before the record does.  When atEnd is set the final line
+ * need not end in '\n'.
+ */
+fastqParseStatus parseFastqRecord( const char * p, const char * end, bool atEnd, fastqRecordView & r, const char *& next );
+
+/*
+ * One record, trimmed, as handed from the parser to pairing: views into the
+ * block it was parsed from (NULL for a memory mapped file, which outlives
+ * every record).
+ */
+struct fastqRecord {
+  dmxView id, seq, qual;
+  dmxBlock * block;
+};
+
+/*
+ * Cuts one mate's stream of blocks into records.  Each block is split into
+ * byte ranges that are parsed by separate TBB tasks; every range but the first
+ * resynchronizes on the first '@' line whose line-after-next starts with '+'
+ * (a quality line may start with '@', but is never followed two lines later by
+ * a '+' line).  Records are appended to the output in file order.  A record
+ * cut off at the end of a block is carried over and parsed, with the start of
+ * the next block, out of a small block of its own.
+ *
+ * The splitter keeps a reference to every block its records point into until
+ * the caller reports, through release, that it has taken those records.
+ */
+class dmxFastqSplitter {
+
+  public:
+
+    static const size_t minRangeSize = 1 << 18;
+
+    dmxFastqSplitter( const char * filename, size_t _trimSize, size_t _numRanges );
+
+    ~dmxFastqSplitter();
+
+    // takes over the caller's reference to block, which may be NULL
+    void parse( dmxBlock * block, const char * data, size_t length, bool atEnd, std::deque< fastqRecord > & out );
+
+    // the caller has taken the first consumed records this splitter produced
+    void release( unsigned long long consumed );
+
+    struct range {
+      size_t begin, end;
+      size_t first, last;   // first record start and end of the last record parsed
+      bool incomplete, malformed;
+      std::deque< fastqRecord > records;
+    };
+
+  private:
+
+    // parses from pos; returns where the first incomplete record starts
+    size_t parseSerial( dmxBlock * block, const char * data, size_t length, bool atEnd, size_t pos, std::deque< fastqRecord > & out );
+    void malformed( const char * data, const char * where );
+    void pin( dmxBlock * block );
+
+    // a block and the number of records produced once its last was
+    struct pinned {
+      dmxBlock * block;
+      unsigned long long end;
+    };
+
+    std::string fileName;
+    size_t trimSize, numRanges;
+    std::string carry;
+    std::vector< range > ranges;
+    unsigned long long offset;
+    unsigned long long produced;
+    std::deque< pinned > pins;
+};
+
+/*
+ * Read-only mapping of a whole (uncompressed) file.
+ */
+class dmxMappedFile {
+
+  public:
+
+    dmxMappedFile( const char * filename );
+    ~dmxMappedFile();
+
+    const char * data() { return begin; }
+    size_t size() { return length; }
+
+  private:
+
+    dmxMappedFile( const dmxMappedFile & );
+    dmxMappedFile & operator=( const dmxMappedFile & );
+
+    const char * begin;
+    size_t length;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXFASTQ_H_
@@ -31,93 +31,114 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 #include <tbb/tbb.h>
 
 ////////// dmxIOBuffer //////////////
 
+const size_t dmxIOBuffer::mappedBlockSize;
 
+dmxIOBuffer::dmxIOBuffer( size_t bufferBlocks, char * filename ) : 
+  numBlocks( bufferBlocks + 1 ), full( numBlocks ) {
 
-dmxIOBuffer::dmxIOBuffer( size_t chunkSize, size_t bufferFactor, char * filename ) {
-  refreshSize = chunkSize * 4 * bufferFactor;
-  bufferSize = refreshSize; 
-  buffer.clear();
-  
-  //file.open( filename );
-  
-  fileStream.open(filename, std::ios_base::in | std::ios_base::binary);
-  gzStream.push( boost::iostreams::gzip_decompressor() );
-  gzStream.push( fileStream );
-
+  inflater = NULL;
+  mapped = NULL;
+  mappedPos = 0;
+  if ( dmxInflater::isGzip( filename ) ) {
+    inflater = new dmxInflater( filename, dmxInflater::defaultBatchBlocks / 4 );
+    for ( size_t i = 0; i < numBlocks; ++i ) {
+      blocks.push_back( new dmxBlock( &empty ) );
+      empty.push( blocks.back() );
+    }
+  }
+  else {
+    mapped = new dmxMappedFile( filename );
+  }
+  block = NULL;
   fileEmpty = false;
+  abandoned = false;
 }
 
 dmxIOBuffer::~dmxIOBuffer() {
-  file.close();
+  for ( size_t i = 0; i < blocks.size(); ++i ) {
+    delete blocks[ i ];
+  }
+  delete inflater;
+  delete mapped;
 }
 
-void dmxIOBuffer::refresh() {
-
-  using namespace std;
-
-  dmxIOBufferMutexT::scoped_lock lock(dmxIOBufferMutex);
-  std::string line;
-
-  //printf( "current buffer size: %lu requested buffer size %lu\n", buffer.size(), bufferSize );
-
-  if ( !fileEmpty ) {
-    //printf( "file is empty?\n");
-    for (size_t i = buffer.size(); i < bufferSize; ++i) {
-      //if ( std::getline( file, line ) ) {
-      if ( std::getline( gzStream, line ) ) {
-        //std::cout << line << std::endl;
-        buffer.push_back( line );
-        //printf( "wtf %lu\n", buffer.size() );
+void dmxIOBuffer::fill() {
+  dmxBlock * b;
+  if ( inflater != NULL ) {
+    while ( !abandoned ) {
+      if ( !empty.try_pop( b ) ) {
+        // every block is still pinned by records waiting to be digested
+        b = new dmxBlock( &empty );
+        blocks.push_back( b );
       }
-      //else if ( !file.eof() ) {
-      //  cout << "problem reading file!" << endl;
-      //  fileEmpty = true;
-      //  break;
-      //}
-      else {
-        fileEmpty = true;
+      if ( !inflater->next( *b ) ) {
+        empty.push( b );
         break;
       }
+      full.push( b );
     }
   }
+  full.close();
 }
 
-bool dmxIOBuffer::fileIsEmpty() {
-  dmxIOBufferMutexT::scoped_lock lock(dmxIOBufferMutex);
+bool dmxIOBuffer::isEmpty() {
   return fileEmpty;
 }
 
-bool dmxIOBuffer::isEmpty() {
-  dmxIOBufferMutexT::scoped_lock lock(dmxIOBufferMutex);
+bool dmxIOBuffer::nextBlock( const char *& data, size_t & length ) {
   if ( fileEmpty ) {
-    if ( buffer.size() == 0 ) {
-      return true;
+    return false;
+  }
+  if ( mapped != NULL ) {
+    if ( mappedPos == mapped->size() ) {
+      fileEmpty = true;
+      return false;
     }
+    data = mapped->data() + mappedPos;
+    length = std::min( mappedBlockSize, mapped->size() - mappedPos );
+    mappedPos += length;
+    return true;
+  }
+  if ( !full.pop( block ) ) {
+    block = NULL;
+    fileEmpty = true;
+    return false;
   }
-  return false;
+  block->refs = 1;
+  data = &block->data[ 0 ];
+  length = block->size();
+  return true;
 }
 
-void dmxIOBuffer::pop_buffer() {
-  dmxIOBufferMutexT::scoped_lock lock(dmxIOBufferMutex);
-  buffer.pop_front();
+dmxBlock * dmxIOBuffer::takeBlock() {
+  dmxBlock * b = block;
+  block = NULL;
+  return b;
 }
 
-bool dmxIOBuffer::getline( std::string & line ) {
-  dmxIOBufferMutexT::scoped_lock lock(dmxIOGetLineMutex);
-  if ( buffer.size() == 0 ) {
-    refresh();
+void dmxIOBuffer::releaseBlock() {
+  if ( block != NULL ) {
+    block->release();
+    block = NULL;
   }
-  
-  if ( buffer.size() > 0 ) {
-    line = buffer.front();
-    pop_buffer();
-    return true;
+}
+
+void dmxIOBuffer::drain() {
+  abandoned = true;
+  releaseBlock();
+  if ( inflater != NULL ) {
+    dmxBlock * b;
+    while ( !fileEmpty && full.pop( b ) ) {
+      empty.push( b );
+    }
   }
-  return false;
+  fileEmpty = true;
 }
 
 //////////// dmxIO ////////////////////
@@ -126,27 +147,30 @@ bool dmxIOBuffer::getline( std::string & line ) {
 dmxIO::dmxIO( char * fileName1, char * fileName2, size_t chunkSize, size_t bufferFactor ) {
 
   buffers.clear();
-  buffers[ fileName1 ] = new dmxIOBuffer( chunkSize, bufferFactor, fileName1 );
-  buffers[ fileName2 ] = new dmxIOBuffer( chunkSize, bufferFactor, fileName2 );
+  buffers[ fileName1 ] = new dmxIOBuffer( bufferFactor * 2, fileName1 );
+  buffers[ fileName2 ] = new dmxIOBuffer( bufferFactor * 2, fileName2 );
+}
 
-  ready_flag = true;
+void dmxIO::fillBuffer( dmxIOBuffer * b ) {
+  b->fill();
 }
 
 void dmxIO::buffer() {
-  while ( !( isEmpty() ) ) {
-    for ( std::map< char * , dmxIOBuffer * >::iterator bit = buffers.begin(); bit != buffers.end(); ++bit ) {
-      (*bit).second->refresh();
-    }
+  // one producer per file; with bounded rings a single thread filling both
+  // could block on one mate while the reader waits on the other
+  std::vector< tbb::tbb_thread * > producers;
+  for ( bufferMap::iterator bit = buffers.begin(); bit != buffers.end(); ++bit ) {
+    producers.push_back( new tbb::tbb_thread( fillBuffer, (*bit).second ) );
+  }
+  for ( size_t i = 0; i < producers.size(); ++i ) {
+    producers[ i ]->join();
+    delete producers[ i ];
   }
 }
 
-bool dmxIO::getline( char * fileName, std::string & line ) {
-  if ( buffers.find( fileName ) != buffers.end() ) {
-    return buffers[ fileName ]->getline( line );
-  }
-  else {
-    printf( "Buffer not found!\n" );
-    return false;
+void dmxIO::drain() {
+  for ( bufferMap::iterator itr = buffers.begin(); itr != buffers.end(); ++itr ) {
+    (*itr).second->drain();
   }
 }
 
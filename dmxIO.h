@@ -57,38 +57,51 @@
 #include <deque>
 #include <list>
 
-#include <boost/iostreams/filtering_stream.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-
-
-typedef tbb::spin_mutex dmxIOBufferMutexT;
-
-
+#include "dmxInflate.h"
+#include "dmxFastq.h"
+#include "dmxRing.h"
+
+
+/*
+ * Blocks of one input file, in file order.  Gzip input is inflated by a
+ * producer thread (fill) into the 'full' ring, which bounds how far ahead it
+ * runs.  Parsed records point into their block, so a block comes back through
+ * 'empty' only once the last chunk using it is digested; the producer adds a
+ * block whenever none has come back yet.  Uncompressed input is memory mapped
+ * and handed out in windows of the mapping without any copy (and without a
+ * block).
+ */
 struct dmxIOBuffer {
 
-  dmxIOBufferMutexT dmxIOBufferMutex;
-  dmxIOBufferMutexT dmxIOGetLineMutex;
+  typedef dmxSpscRing< dmxBlock * > blockRing;
 
-  size_t bufferSize, refreshSize;
-  std::deque < std::string > buffer;
-  std::ifstream file;
-  tbb::atomic< bool > fileEmpty;
+  static const size_t mappedBlockSize = 1 << 24;
 
-  dmxIOBuffer( size_t chunkSize, size_t bufferFactor, char * filename ); 
+  dmxIOBuffer( size_t bufferBlocks, char * filename ); 
   ~dmxIOBuffer();
-  void refresh();
-  bool fileIsEmpty();
+
+  // producer side; returns at end of file
+  void fill();
+
+  // consumer side; the block holds one reference for the consumer, given up
+  // by releaseBlock or taken over by whoever calls takeBlock
+  bool nextBlock( const char *& data, size_t & length );
+  dmxBlock * takeBlock();
+  void releaseBlock();
   bool isEmpty();
-  bool getline( std::string & line );
+  void drain();
 
-  void pop_buffer();
+  size_t numBlocks;
+  std::vector< dmxBlock * > blocks;
+  blockRing full;
+  tbb::concurrent_queue< dmxBlock * > empty;
 
-  size_t size() {
-    return buffer.size();
-  }
+  dmxInflater * inflater;
+  dmxMappedFile * mapped;
+  size_t mappedPos;
 
-  std::ifstream fileStream;
-  boost::iostreams::filtering_istream gzStream;  
+  dmxBlock * block;
+  tbb::atomic< bool > fileEmpty, abandoned;
 };
 
 typedef std::map< char * , dmxIOBuffer * > bufferMap;
@@ -101,17 +114,16 @@ class dmxIO {
 
     bufferMap buffers;
 
-    bool getline( char * fileName, std::string & line );
-    
     void buffer();
 
     bool isEmpty();
 
-    bool ready() { return ready_flag; }
+    // releases producers still blocked on files the reader has stopped reading
+    void drain();
 
   private:
 
-    tbb::atomic< bool > ready_flag;
+    static void fillBuffer( dmxIOBuffer * b );
 };
 
 
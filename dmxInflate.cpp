@@ -0,0 +1,267 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxInflate.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <tbb/tbb.h>
+
+namespace {
+
+  struct inflateMembersFunctor {
+
+    const char * in;
+    char * out;
+    const dmxInflater::member * members;
+    tbb::atomic< bool > * ok;
+
+    void operator()( const tbb::blocked_range< size_t > & r ) const {
+      for ( size_t i = r.begin(); i != r.end(); ++i ) {
+        const dmxInflater::member & m = members[ i ];
+        z_stream zs;
+        memset( &zs, 0, sizeof( zs ) );
+        // 15 + 16: expect a gzip wrapper, so zlib checks the member CRC for us
+        if ( inflateInit2( &zs, 15 + 16 ) != Z_OK ) {
+          (*ok) = false;
+          return;
+        }
+        zs.next_in = (Bytef *) ( in + m.offset );
+        zs.avail_in = m.compressedSize;
+        zs.next_out = (Bytef *) ( out + m.outputOffset );
+        zs.avail_out = m.inflatedSize;
+        int ret = inflate( &zs, Z_FINISH );
+        if ( ret != Z_STREAM_END || zs.avail_out != 0 ) {
+          (*ok) = false;
+        }
+        inflateEnd( &zs );
+      }
+    }
+  };
+
+  inline size_t le16( const unsigned char * p ) {
+    return (size_t) p[ 0 ] | ( (size_t) p[ 1 ] << 8 );
+  }
+
+  inline size_t le32( const unsigned char * p ) {
+    return le16( p ) | ( le16( p + 2 ) << 16 );
+  }
+}
+
+dmxInflater::dmxInflater( const char * filename, size_t _batchBlocks ) {
+  fileName = filename;
+  batchBlocks = _batchBlocks > 0 ? _batchBlocks : defaultBatchBlocks;
+  streamOpen = false;
+  streamDone = false;
+
+  file = fopen( filename, "rb" );
+  if ( file == NULL ) {
+    fail( "unable to open" );
+  }
+
+  unsigned char header[ 512 ];
+  size_t n = fread( header, 1, sizeof( header ), file );
+  if ( n < 2 || header[ 0 ] != 0x1f || header[ 1 ] != 0x8b ) {
+    fail( "not a gzip file" );
+  }
+  size_t blockSize;
+  fileFormat = bgzfBlockSize( header, n, blockSize ) ? BGZF : GZIP;
+  rewind( file );
+
+  if ( fileFormat == GZIP ) {
+    memset( &stream, 0, sizeof( stream ) );
+    // 15 + 32: auto-detect the gzip/zlib wrapper
+    if ( inflateInit2( &stream, 15 + 32 ) != Z_OK ) {
+      fail( "unable to initialize zlib" );
+    }
+    streamOpen = true;
+    streamInput.resize( 1 << 20 );
+  }
+}
+
+dmxInflater::~dmxInflater() {
+  if ( streamOpen ) {
+    inflateEnd( &stream );
+  }
+  if ( file != NULL ) {
+    fclose( file );
+  }
+}
+
+bool dmxInflater::isGzip( const char * filename ) {
+  unsigned char magic[ 2 ];
+  FILE * f = fopen( filename, "rb" );
+  if ( f == NULL ) {
+    return false;
+  }
+  size_t n = fread( magic, 1, 2, f );
+  fclose( f );
+  return n == 2 && magic[ 0 ] == 0x1f && magic[ 1 ] == 0x8b;
+}
+
+void dmxInflater::fail( const char * what ) {
+  std::cerr << "Error reading " << fileName << ": " << what << std::endl;
+  std::exit( 1 );
+}
+
+bool dmxInflater::bgzfBlockSize( const unsigned char * header, size_t length, size_t & blockSize ) {
+  // fixed gzip header is 12 bytes when FEXTRA is set; BSIZE lives in the 'BC' subfield
+  if ( length < 12 || header[ 0 ] != 0x1f || header[ 1 ] != 0x8b || header[ 2 ] != 8 || !( header[ 3 ] & 4 ) ) {
+    return false;
+  }
+  size_t xlen = le16( header + 10 );
+  if ( length < 12 + xlen ) {
+    return false;
+  }
+  const unsigned char * extra = header + 12;
+  for ( size_t i = 0; i + 4 <= xlen; ) {
+    size_t slen = le16( extra + i + 2 );
+    if ( extra[ i ] == 'B' && extra[ i + 1 ] == 'C' && slen == 2 && i + 6 <= xlen ) {
+      blockSize = le16( extra + i + 4 ) + 1;
+      return true;
+    }
+    i += 4 + slen;
+  }
+  return false;
+}
+
+bool dmxInflater::readMember( std::vector< char > & buf, member & m ) {
+  unsigned char header[ 12 ];
+  size_t n = fread( header, 1, 12, file );
+  if ( n == 0 ) {
+    return false;
+  }
+  if ( n < 12 ) {
+    fail( "truncated BGZF block header" );
+  }
+
+  size_t xlen = le16( header + 10 );
+  m.offset = buf.size();
+  buf.resize( m.offset + 12 + xlen );
+  memcpy( &buf[ m.offset ], header, 12 );
+  if ( fread( &buf[ m.offset + 12 ], 1, xlen, file ) != xlen ) {
+    fail( "truncated BGZF block header" );
+  }
+
+  size_t blockSize;
+  if ( !bgzfBlockSize( (const unsigned char *) &buf[ m.offset ], 12 + xlen, blockSize ) || blockSize < 12 + xlen + 8 ) {
+    fail( "gzip member without BGZF block size in a BGZF file" );
+  }
+
+  size_t rest = blockSize - 12 - xlen;
+  buf.resize( m.offset + blockSize );
+  if ( fread( &buf[ m.offset + 12 + xlen ], 1, rest, file ) != rest ) {
+    fail( "truncated BGZF block" );
+  }
+
+  m.compressedSize = blockSize;
+  m.inflatedSize = le32( (const unsigned char *) &buf[ m.offset + blockSize - 4 ] );
+  return true;
+}
+
+bool dmxInflater::next( dmxBlock & block ) {
+  if ( fileFormat == BGZF ) {
+    return nextBgzf( block );
+  }
+  return nextGzip( block );
+}
+
+bool dmxInflater::nextBgzf( dmxBlock & block ) {
+  compressed.clear();
+  members.clear();
+
+  size_t total = 0;
+  member m;
+  while ( members.size() < batchBlocks && readMember( compressed, m ) ) {
+    m.outputOffset = total;
+    total += m.inflatedSize;
+    members.push_back( m );
+  }
+  if ( members.empty() ) {
+    return false;
+  }
+
+  block.data.resize( total );
+  if ( total == 0 ) {
+    // only the empty EOF marker block(s) were left
+    return nextBgzf( block );
+  }
+
+  tbb::atomic< bool > ok;
+  ok = true;
+  inflateMembersFunctor f;
+  f.in = &compressed[ 0 ];
+  f.out = &block.data[ 0 ];
+  f.members = &members[ 0 ];
+  f.ok = &ok;
+  tbb::parallel_for( tbb::blocked_range< size_t >( 0, members.size(), 1 ), f );
+
+  if ( !ok ) {
+    fail( "corrupt BGZF block" );
+  }
+  return true;
+}
+
+bool dmxInflater::nextGzip( dmxBlock & block ) {
+  block.data.resize( streamBlockSize );
+  size_t produced = 0;
+
+  while ( produced < streamBlockSize && !streamDone ) {
+    if ( stream.avail_in == 0 ) {
+      size_t n = fread( &streamInput[ 0 ], 1, streamInput.size(), file );
+      if ( n == 0 ) {
+        streamDone = true;
+        break;
+      }
+      stream.next_in = (Bytef *) &streamInput[ 0 ];
+      stream.avail_in = n;
+    }
+
+    stream.next_out = (Bytef *) &block.data[ produced ];
+    stream.avail_out = streamBlockSize - produced;
+    int ret = inflate( &stream, Z_NO_FLUSH );
+    produced = streamBlockSize - stream.avail_out;
+
+    if ( ret == Z_STREAM_END ) {
+      // concatenated members: start over on whatever follows
+      inflateReset( &stream );
+    }
+    else if ( ret != Z_OK && ret != Z_BUF_ERROR ) {
+      fail( "corrupt gzip stream" );
+    }
+  }
+
+  block.data.resize( produced );
+  return produced > 0;
+}
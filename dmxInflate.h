@@ -0,0 +1,135 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXINFLATE_H_
+#define SANDBOX_JVD_APPS_DMX_DMXINFLATE_H_
+
+#include <cstdio>
+#include <vector>
+#include <string>
+
+#include <zlib.h>
+
+#include <tbb/atomic.h>
+#include <tbb/concurrent_queue.h>
+
+/*
+ * A run of decompressed bytes, handed out in file order.  Records parsed out
+ * of a block point into it, so it is reference counted: whoever keeps such a
+ * record (the splitter, a chunk) holds a reference, and when the last one is
+ * released the block goes back to home for reuse, or is deleted if it has
+ * none.
+ */
+struct dmxBlock {
+  std::vector< char > data;
+  tbb::atomic< int > refs;
+  tbb::concurrent_queue< dmxBlock * > * home;
+
+  dmxBlock( tbb::concurrent_queue< dmxBlock * > * _home = NULL ) : home( _home ) { refs = 0; }
+
+  size_t size() { return data.size(); }
+
+  void retain() { ++refs; }
+  void release() {
+    if ( --refs == 0 ) {
+      if ( home != NULL ) {
+        home->push( this );
+      }
+      else {
+        delete this;
+      }
+    }
+  }
+};
+
+/*
+ * Decompresses a gzip file into dmxBlocks.  BGZF input (and any other
+ * multi-member gzip whose members carry the BGZF 'BC' block size field) is
+ * inflated a batch of members at a time, with the members of a batch spread
+ * across the TBB worker threads.  Plain gzip has no way to find member
+ * boundaries without inflating, so it falls back to a single zlib stream that
+ * restarts on each member.
+ */
+class dmxInflater {
+
+  public:
+
+    enum formatType { GZIP, BGZF };
+
+    static const size_t defaultBatchBlocks = 256;
+    static const size_t streamBlockSize = 1 << 22;
+
+    dmxInflater( const char * filename, size_t _batchBlocks = defaultBatchBlocks );
+    ~dmxInflater();
+
+    formatType format() { return fileFormat; }
+
+    // true if the file starts with the gzip magic bytes
+    static bool isGzip( const char * filename );
+
+    // fills block with the next decompressed bytes; false at end of file
+    bool next( dmxBlock & block );
+
+    struct member {
+      size_t offset, compressedSize, inflatedSize, outputOffset;
+    };
+
+  private:
+
+    bool nextBgzf( dmxBlock & block );
+    bool nextGzip( dmxBlock & block );
+
+    bool readMember( std::vector< char > & buf, member & m );
+    static bool bgzfBlockSize( const unsigned char * header, size_t length, size_t & blockSize );
+
+    void fail( const char * what );
+
+    std::string fileName;
+    FILE * file;
+    formatType fileFormat;
+    size_t batchBlocks;
+
+    // BGZF: compressed bytes and member table for the current batch
+    std::vector< char > compressed;
+    std::vector< member > members;
+
+    // plain gzip: one zlib stream that is reset at each member boundary
+    z_stream stream;
+    bool streamOpen;
+    std::vector< char > streamInput;
+    bool streamDone;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXINFLATE_H_
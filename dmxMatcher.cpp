@@ -0,0 +1,229 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxMatcher.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+dmxMatcher::dmxMatcher() {
+  start = 0;
+  length = 0;
+  maxDistance = 0;
+}
+
+void dmxMatcher::build( const std::vector< std::string > & barcodeStrings, unsigned _start, unsigned _length, unsigned _maxDistance ) {
+  start = _start;
+  length = _length;
+  maxDistance = _maxDistance;
+  barcodes = barcodeStrings;
+
+  if ( length == 0 || length > maxTableLength ) {
+    std::cerr << "Barcode length " << length << " is not supported (1 to " << maxTableLength << " bases)" << std::endl;
+    std::exit( 1 );
+  }
+  if ( maxDistance > maxTableDistance ) {
+    std::cerr << "At most " << maxTableDistance << " barcode mismatches are supported" << std::endl;
+    std::exit( 1 );
+  }
+
+  entry empty;
+  empty.index = noBarcode;
+  empty.distance = 0;
+  table.assign( (size_t) 1 << ( 2 * length ), empty );
+
+  for ( size_t b = 0; b < barcodes.size(); ++b ) {
+    const std::string & s = barcodes[ b ];
+    if ( s.size() != length ) {
+      std::cerr << "Barcode " << s << " does not match the barcode length " << length << std::endl;
+      std::exit( 1 );
+    }
+    size_t code = 0;
+    for ( unsigned i = 0; i < length; ++i ) {
+      int c = baseCode( s[ i ] );
+      if ( c < 0 ) {
+        std::cerr << "Barcode " << s << " contains a base other than ACGT" << std::endl;
+        std::exit( 1 );
+      }
+      code = ( code << 2 ) | c;
+    }
+    insert( code, b, 0 );
+
+    // flipping a base is an xor of its 2-bit code with 1, 2 or 3
+    for ( unsigned i = 0; maxDistance >= 1 && i < length; ++i ) {
+      size_t shift1 = 2 * ( length - 1 - i );
+      for ( size_t x1 = 1; x1 < 4; ++x1 ) {
+        size_t code1 = code ^ ( x1 << shift1 );
+        insert( code1, b, 1 );
+        for ( unsigned j = i + 1; maxDistance >= 2 && j < length; ++j ) {
+          size_t shift2 = 2 * ( length - 1 - j );
+          for ( size_t x2 = 1; x2 < 4; ++x2 ) {
+            insert( code1 ^ ( x2 << shift2 ), b, 2 );
+          }
+        }
+      }
+    }
+  }
+}
+
+void dmxMatcher::insert( size_t code, short index, unsigned char distance ) {
+  entry & e = table[ code ];
+  if ( e.index == noBarcode || distance < e.distance ) {
+    e.index = index;
+    e.distance = distance;
+  }
+  else if ( distance == e.distance && e.index != index ) {
+    e.index = ambiguousBarcode;
+  }
+}
+
+dmxMatch dmxMatcher::match( const dmxView & seq, int shift ) const {
+  dmxMatch m;
+  m.min = length + 1;
+  m.index = -1;
+  m.shift = shift;
+
+  long windowStart = (long) start + shift;
+  if ( windowStart < 0 || (long) seq.size() < windowStart + (long) length ) {
+    return m;
+  }
+  const char * window = seq.data() + windowStart;
+  size_t code = 0;
+  for ( unsigned i = 0; i < length; ++i ) {
+    int c = baseCode( window[ i ] );
+    if ( c < 0 ) {
+      m = scan( window );
+      m.shift = shift;
+      return m;
+    }
+    code = ( code << 2 ) | c;
+  }
+  const entry & e = table[ code ];
+  if ( e.index >= 0 ) {
+    m.min = e.distance;
+    m.index = e.index;
+  }
+  return m;
+}
+
+dmxMatch dmxMatcher::scan( const char * window ) const {
+  // an N (or any other non-ACGT) counts as a mismatch against every barcode
+  dmxMatch m;
+  m.min = length + 1;
+  m.index = -1;
+  m.shift = 0;
+  bool tie = false;
+  for ( size_t b = 0; b < barcodes.size(); ++b ) {
+    const std::string & s = barcodes[ b ];
+    unsigned dist = 0;
+    for ( unsigned i = 0; i < length && dist <= maxDistance; ++i ) {
+      int c = baseCode( window[ i ] );
+      if ( c < 0 || c != baseCode( s[ i ] ) ) {
+        ++dist;
+      }
+    }
+    if ( dist < m.min ) {
+      m.min = dist;
+      m.index = b;
+      tie = false;
+    }
+    else if ( dist == m.min ) {
+      tie = true;
+    }
+  }
+  if ( tie || m.min > maxDistance ) {
+    m.min = length + 1;
+    m.index = -1;
+  }
+  return m;
+}
+
+void dmxLayoutMatcher::build( const std::vector< barcode * > & barcodeList, unsigned maxDistance ) {
+  groups.clear();
+  noMatchDistance = 0;
+  for ( size_t i = 0; i < barcodeList.size(); ++i ) {
+    barcode & b = *barcodeList[ i ];
+    size_t g = 0;
+    while ( g < groups.size() && groups[ g ].layout != b.layout ) {
+      ++g;
+    }
+    if ( g == groups.size() ) {
+      groups.push_back( group() );
+      groups[ g ].layout = b.layout;
+      groups[ g ].minReadLength = std::max( b.barcodeStart + b.barcodeLength, b.seqStart );
+    }
+    groups[ g ].barcodeIndex.push_back( i );
+    noMatchDistance = std::max( noMatchDistance, b.barcodeLength + 1 );
+  }
+
+  for ( size_t g = 0; g < groups.size(); ++g ) {
+    std::vector< std::string > barcodeStrings;
+    for ( size_t i = 0; i < groups[ g ].barcodeIndex.size(); ++i ) {
+      barcodeStrings.push_back( barcodeList[ groups[ g ].barcodeIndex[ i ] ]->barcodeString );
+    }
+    barcode & first = *barcodeList[ groups[ g ].barcodeIndex[ 0 ] ];
+    groups[ g ].matcher.build( barcodeStrings, first.barcodeStart, first.barcodeLength, maxDistance );
+  }
+}
+
+dmxMatch dmxLayoutMatcher::match( const dmxView & seq, int shift ) const {
+  dmxMatch m;
+  m.min = noMatchDistance;
+  m.index = -1;
+  m.shift = shift;
+  bool tie = false;
+  for ( size_t g = 0; g < groups.size(); ++g ) {
+    // the whole layout, moved by the shift, must fit in the read
+    if ( (long) seq.size() < (long) groups[ g ].minReadLength + shift ) {
+      continue;
+    }
+    dmxMatch gm = groups[ g ].matcher.match( seq, shift );
+    if ( gm.index < 0 ) {
+      continue;
+    }
+    if ( m.index < 0 || gm.min < m.min ) {
+      m.min = gm.min;
+      m.index = groups[ g ].barcodeIndex[ gm.index ];
+      tie = false;
+    }
+    else if ( gm.min == m.min ) {
+      tie = true;
+    }
+  }
+  if ( tie ) {
+    m.min = noMatchDistance;
+    m.index = -1;
+  }
+  return m;
+}
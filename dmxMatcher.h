@@ -0,0 +1,137 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXMATCHER_H_
+#define SANDBOX_JVD_APPS_DMX_DMXMATCHER_H_
+
+#include <string>
+#include <vector>
+
+#include "dmxBarcode.h"
+#include "dmxView.h"
+
+/*
+ * Result of a barcode search: the index of the best barcode (or -1 if there
+ * is none within the allowed distance, or more than one ties for best), its
+ * distance from the read, and how far the layout was moved to find it.
+ */
+struct dmxMatch {
+  unsigned min;
+  int index;
+  int shift;
+};
+
+/*
+ * Assigns reads to barcodes by looking up the barcode window of the read in
+ * a flat table indexed by the 2-bit packed window.  The table is filled once,
+ * up front, with every sequence within maxDistance mismatches of a barcode;
+ * a sequence equally close to two barcodes is marked ambiguous.  Windows
+ * containing anything but ACGT fall back to a scan over the barcodes.
+ */
+class dmxMatcher {
+
+  public:
+
+    // the table has 4^length entries
+    static const unsigned maxTableLength = 12;
+    static const unsigned maxTableDistance = 2;
+
+    static const short noBarcode = -1;
+    static const short ambiguousBarcode = -2;
+
+    dmxMatcher();
+
+    void build( const std::vector< std::string > & barcodeStrings, unsigned _start, unsigned _length, unsigned _maxDistance );
+
+    // looks up the window at the barcode position moved by shift
+    dmxMatch match( const dmxView & seq, int shift = 0 ) const;
+
+    // 2-bit code of a base, or -1 for anything that is not ACGT
+    static inline int baseCode( char c ) {
+      switch ( c ) {
+        case 'A': case 'a': return 0;
+        case 'C': case 'c': return 1;
+        case 'G': case 'g': return 2;
+        case 'T': case 't': return 3;
+        default: return -1;
+      }
+    }
+
+  private:
+
+    struct entry {
+      short index;
+      unsigned char distance;
+    };
+
+    void insert( size_t code, short index, unsigned char distance );
+
+    dmxMatch scan( const char * window ) const;
+
+    std::vector< entry > table;
+    std::vector< std::string > barcodes;
+    unsigned start, length, maxDistance;
+};
+
+/*
+ * Matches reads against barcodes with different layouts.  Barcodes sharing a
+ * layout string form a group with its own dmxMatcher over that layout's
+ * barcode window, and a read is only tried against the groups whose layout
+ * fits within it.  The closest barcode over all groups wins; a tie between
+ * groups is ambiguous.
+ */
+class dmxLayoutMatcher {
+
+  public:
+
+    void build( const std::vector< barcode * > & barcodeList, unsigned maxDistance );
+
+    dmxMatch match( const dmxView & seq, int shift = 0 ) const;
+
+  private:
+
+    struct group {
+      std::string layout;
+      size_t minReadLength;
+      dmxMatcher matcher;
+      // index in barcodeList of each of the group's barcodes
+      std::vector< int > barcodeIndex;
+    };
+
+    std::vector< group > groups;
+    unsigned noMatchDistance;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXMATCHER_H_
@@ -0,0 +1,381 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxMyers.h"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define DMX_MYERS_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+  const int codeN = 4;
+
+  // what the kernels load for each text position: for the byte shuffle, the
+  // table entries holding the low and high bytes of the pattern word; the
+  // scalar kernel only looks at the low byte
+  inline unsigned short columnCode( int code ) {
+    return (unsigned short) ( code | ( ( code + 8 ) << 8 ) );
+  }
+
+  /*
+   * Myers' infix search of one pattern of length m against laneCount texts
+   * given column by column, leaving the lowest edit distance seen in each
+   * lane in best and the column where the first such match ends in bestEnd.
+   * A shift brings in a zero at the bottom of the horizontal deltas, so a
+   * match may start anywhere in the text.  The SIMD kernels are compiled for
+   * their instruction set whatever the rest of the tree targets, and only
+   * called once the CPU has been seen to support it.
+   */
+#if defined( DMX_MYERS_X86 )
+  __attribute__(( target( "avx2" ) ))
+  void myersBlockAvx2( const unsigned short * columns, size_t numColumns, const unsigned char * peq, unsigned m, unsigned short * best, unsigned short * bestEnd ) {
+    // the byte shuffle works within 128-bit halves, so both get the table
+    __m256i table = _mm256_broadcastsi128_si256( _mm_loadu_si128( (const __m128i *) peq ) );
+    __m256i ones = _mm256_set1_epi16( -1 );
+    __m256i one = _mm256_set1_epi16( 1 );
+    __m128i high = _mm_cvtsi32_si128( m - 1 );
+    __m256i pv = ones;
+    __m256i mv = _mm256_setzero_si256();
+    __m256i score = _mm256_set1_epi16( m );
+    __m256i low = score;
+    __m256i lowEnd = _mm256_setzero_si256();
+    for ( size_t j = 0; j < numColumns; ++j ) {
+      __m256i eq = _mm256_shuffle_epi8( table, _mm256_loadu_si256( (const __m256i *) ( columns + j * 16 ) ) );
+      __m256i xv = _mm256_or_si256( eq, mv );
+      __m256i xh = _mm256_or_si256( _mm256_xor_si256( _mm256_add_epi16( _mm256_and_si256( eq, pv ), pv ), pv ), eq );
+      __m256i ph = _mm256_or_si256( mv, _mm256_andnot_si256( _mm256_or_si256( xh, pv ), ones ) );
+      __m256i mh = _mm256_and_si256( pv, xh );
+      score = _mm256_add_epi16( score, _mm256_and_si256( _mm256_srl_epi16( ph, high ), one ) );
+      score = _mm256_sub_epi16( score, _mm256_and_si256( _mm256_srl_epi16( mh, high ), one ) );
+      ph = _mm256_slli_epi16( ph, 1 );
+      mh = _mm256_slli_epi16( mh, 1 );
+      pv = _mm256_or_si256( mh, _mm256_andnot_si256( _mm256_or_si256( xv, ph ), ones ) );
+      mv = _mm256_and_si256( ph, xv );
+      __m256i lower = _mm256_cmpgt_epi16( low, score );
+      lowEnd = _mm256_blendv_epi8( lowEnd, _mm256_set1_epi16( j ), lower );
+      low = _mm256_min_epi16( low, score );
+    }
+    _mm256_storeu_si256( (__m256i *) best, low );
+    _mm256_storeu_si256( (__m256i *) bestEnd, lowEnd );
+  }
+
+  __attribute__(( target( "sse4.1" ) ))
+  void myersBlockSse41( const unsigned short * columns, size_t numColumns, const unsigned char * peq, unsigned m, unsigned short * best, unsigned short * bestEnd ) {
+    __m128i table = _mm_loadu_si128( (const __m128i *) peq );
+    __m128i ones = _mm_set1_epi16( -1 );
+    __m128i one = _mm_set1_epi16( 1 );
+    __m128i high = _mm_cvtsi32_si128( m - 1 );
+    __m128i pv = ones;
+    __m128i mv = _mm_setzero_si128();
+    __m128i score = _mm_set1_epi16( m );
+    __m128i low = score;
+    __m128i lowEnd = _mm_setzero_si128();
+    for ( size_t j = 0; j < numColumns; ++j ) {
+      __m128i eq = _mm_shuffle_epi8( table, _mm_loadu_si128( (const __m128i *) ( columns + j * 8 ) ) );
+      __m128i xv = _mm_or_si128( eq, mv );
+      __m128i xh = _mm_or_si128( _mm_xor_si128( _mm_add_epi16( _mm_and_si128( eq, pv ), pv ), pv ), eq );
+      __m128i ph = _mm_or_si128( mv, _mm_andnot_si128( _mm_or_si128( xh, pv ), ones ) );
+      __m128i mh = _mm_and_si128( pv, xh );
+      score = _mm_add_epi16( score, _mm_and_si128( _mm_srl_epi16( ph, high ), one ) );
+      score = _mm_sub_epi16( score, _mm_and_si128( _mm_srl_epi16( mh, high ), one ) );
+      ph = _mm_slli_epi16( ph, 1 );
+      mh = _mm_slli_epi16( mh, 1 );
+      pv = _mm_or_si128( mh, _mm_andnot_si128( _mm_or_si128( xv, ph ), ones ) );
+      mv = _mm_and_si128( ph, xv );
+      __m128i lower = _mm_cmpgt_epi16( low, score );
+      lowEnd = _mm_blendv_epi8( lowEnd, _mm_set1_epi16( j ), lower );
+      low = _mm_min_epi16( low, score );
+    }
+    _mm_storeu_si128( (__m128i *) best, low );
+    _mm_storeu_si128( (__m128i *) bestEnd, lowEnd );
+  }
+#endif
+
+  void myersBlockScalar( const unsigned short * columns, size_t numColumns, const unsigned char * peq, unsigned m, unsigned short * best, unsigned short * bestEnd ) {
+    unsigned long long eqOf[ 5 ];
+    for ( int c = 0; c <= codeN; ++c ) {
+      eqOf[ c ] = peq[ c ] | ( (unsigned long long) peq[ c + 8 ] << 8 );
+    }
+    unsigned long long pv = ~0ULL;
+    unsigned long long mv = 0;
+    unsigned score = m;
+    unsigned low = m;
+    unsigned lowEnd = 0;
+    for ( size_t j = 0; j < numColumns; ++j ) {
+      unsigned long long eq = eqOf[ columns[ j ] & 0xff ];
+      unsigned long long xv = eq | mv;
+      unsigned long long xh = ( ( ( eq & pv ) + pv ) ^ pv ) | eq;
+      unsigned long long ph = mv | ~( xh | pv );
+      unsigned long long mh = pv & xh;
+      score += ( ph >> ( m - 1 ) ) & 1;
+      score -= ( mh >> ( m - 1 ) ) & 1;
+      ph <<= 1;
+      mh <<= 1;
+      pv = mh | ~( xv | ph );
+      mv = ph & xv;
+      if ( score < low ) {
+        low = score;
+        lowEnd = j;
+      }
+    }
+    best[ 0 ] = low;
+    bestEnd[ 0 ] = lowEnd;
+  }
+
+  dmxMyersKernel pickKernel() {
+    dmxMyersKernel k = { "scalar", 1, myersBlockScalar };
+#if defined( DMX_MYERS_X86 )
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) ) {
+      dmxMyersKernel avx2 = { "avx2", 16, myersBlockAvx2 };
+      k = avx2;
+    }
+    else if ( __builtin_cpu_supports( "sse4.1" ) ) {
+      dmxMyersKernel sse41 = { "sse4.1", 8, myersBlockSse41 };
+      k = sse41;
+    }
+#endif
+    // DMX_MYERS_KERNEL=scalar (or sse4.1) asks for a narrower kernel, to
+    // compare them on one machine
+    const char * wanted = std::getenv( "DMX_MYERS_KERNEL" );
+    if ( wanted != NULL && std::string( wanted ) == "scalar" ) {
+      dmxMyersKernel scalar = { "scalar", 1, myersBlockScalar };
+      k = scalar;
+    }
+#if defined( DMX_MYERS_X86 )
+    else if ( wanted != NULL && std::string( wanted ) == "sse4.1" && k.laneCount > 8 ) {
+      dmxMyersKernel sse41 = { "sse4.1", 8, myersBlockSse41 };
+      k = sse41;
+    }
+#endif
+    return k;
+  }
+}
+
+const unsigned dmxPrimerAnchor::maxAnchorLength;
+
+const dmxMyersKernel & dmxMyersKernel::select() {
+  static const dmxMyersKernel chosen = pickKernel();
+  return chosen;
+}
+
+namespace {
+
+  // appends the 16 byte shuffle table of pattern bits for each base
+  void appendPeq( std::vector< unsigned char > & peq, const std::string & pattern ) {
+    unsigned char table[ 16 ] = { 0 };
+    for ( unsigned k = 0; k < pattern.size(); ++k ) {
+      int c = dmxMatcher::baseCode( pattern[ k ] );
+      if ( c < 0 ) {
+        std::cerr << "Pattern " << pattern << " contains a base other than ACGT" << std::endl;
+        std::exit( 1 );
+      }
+      unsigned bit = 1u << k;
+      table[ c ] |= bit & 0xff;
+      table[ c + 8 ] |= bit >> 8;
+    }
+    peq.insert( peq.end(), table, table + 16 );
+  }
+
+  // lays the windows of seqs[ first ] onward out column by column, each read
+  // moved by its shift if there are any; positions outside a read, and
+  // unused lanes, read as N and match nothing
+  void fillColumns( std::vector< unsigned short > & columns, size_t laneCount, const dmxView * seqs, const int * shifts,
+      size_t first, size_t lanes, long windowStart, unsigned windowLength ) {
+    columns.resize( windowLength * laneCount );
+    for ( size_t lane = 0; lane < laneCount; ++lane ) {
+      const dmxView * seq = lane < lanes ? &seqs[ first + lane ] : NULL;
+      long start = windowStart + ( seq != NULL && shifts != NULL ? shifts[ first + lane ] : 0 );
+      for ( unsigned j = 0; j < windowLength; ++j ) {
+        long pos = start + j;
+        int c = seq != NULL && pos >= 0 && (size_t) pos < seq->size() ? dmxMatcher::baseCode( (*seq)[ pos ] ) : -1;
+        columns[ j * laneCount + lane ] = columnCode( c < 0 ? codeN : c );
+      }
+    }
+  }
+}
+
+void dmxMyersMatcher::build( const std::vector< barcode * > & barcodeList, unsigned _maxDistance ) {
+  kernel = &dmxMyersKernel::select();
+  maxDistance = _maxDistance;
+  groups.clear();
+  noMatchDistance = 0;
+  for ( size_t i = 0; i < barcodeList.size(); ++i ) {
+    barcode & b = *barcodeList[ i ];
+    if ( b.barcodeLength == 0 || b.barcodeLength > maxPatternLength ) {
+      std::cerr << "Barcode length " << b.barcodeLength << " is not supported by the myers matcher (1 to " << maxPatternLength << " bases)" << std::endl;
+      std::exit( 1 );
+    }
+    size_t g = 0;
+    while ( g < groups.size() && groups[ g ].layout != b.layout ) {
+      ++g;
+    }
+    if ( g == groups.size() ) {
+      groups.push_back( group() );
+      group & ng = groups[ g ];
+      ng.layout = b.layout;
+      ng.minReadLength = std::max( b.barcodeStart + b.barcodeLength, b.seqStart );
+      ng.windowStart = b.barcodeStart > maxDistance ? b.barcodeStart - maxDistance : 0;
+      ng.windowLength = b.barcodeStart + b.barcodeLength + maxDistance - ng.windowStart;
+      ng.patternLength = b.barcodeLength;
+    }
+    group & bg = groups[ g ];
+    bg.barcodeIndex.push_back( i );
+    appendPeq( bg.peq, b.barcodeString );
+    noMatchDistance = std::max( noMatchDistance, b.barcodeLength + 1 );
+  }
+}
+
+void dmxMyersMatcher::match( const dmxView * seqs, size_t n, dmxMatch * out, const int * shifts ) const {
+  std::vector< char > tie( n, 0 );
+  for ( size_t i = 0; i < n; ++i ) {
+    out[ i ].min = noMatchDistance;
+    out[ i ].index = -1;
+    out[ i ].shift = shifts != NULL ? shifts[ i ] : 0;
+  }
+
+  const size_t laneCount = kernel->laneCount;
+  std::vector< unsigned short > columns;
+  unsigned short best[ dmxMyersKernel::maxLaneCount ], bestEnd[ dmxMyersKernel::maxLaneCount ];
+  for ( size_t g = 0; g < groups.size(); ++g ) {
+    const group & gr = groups[ g ];
+    for ( size_t first = 0; first < n; first += laneCount ) {
+      size_t lanes = std::min( laneCount, n - first );
+      fillColumns( columns, laneCount, seqs, shifts, first, lanes, gr.windowStart, gr.windowLength );
+
+      for ( size_t b = 0; b < gr.barcodeIndex.size(); ++b ) {
+        kernel->block( &columns[ 0 ], gr.windowLength, &gr.peq[ b * 16 ], gr.patternLength, best, bestEnd );
+        for ( size_t lane = 0; lane < lanes; ++lane ) {
+          size_t i = first + lane;
+          unsigned d = best[ lane ];
+          // the whole layout, moved by the shift, must fit in the read
+          if ( d > maxDistance || (long) seqs[ i ].size() < (long) gr.minReadLength + out[ i ].shift ) {
+            continue;
+          }
+          if ( out[ i ].index < 0 || d < out[ i ].min ) {
+            out[ i ].min = d;
+            out[ i ].index = gr.barcodeIndex[ b ];
+            tie[ i ] = 0;
+          }
+          else if ( d == out[ i ].min ) {
+            tie[ i ] = 1;
+          }
+        }
+      }
+    }
+  }
+
+  for ( size_t i = 0; i < n; ++i ) {
+    if ( tie[ i ] ) {
+      out[ i ].min = noMatchDistance;
+      out[ i ].index = -1;
+    }
+  }
+}
+
+dmxMatch dmxMyersMatcher::match( const dmxView & seq, int shift ) const {
+  dmxMatch m;
+  match( &seq, 1, &m, &shift );
+  return m;
+}
+
+void dmxPrimerAnchor::build( const std::vector< barcode * > & barcodeList, unsigned _maxShift ) {
+  kernel = &dmxMyersKernel::select();
+  maxShift = _maxShift;
+  anchors.clear();
+  minLayoutStart = maxShift;
+  for ( size_t i = 0; i < barcodeList.size(); ++i ) {
+    barcode & b = *barcodeList[ i ];
+    unsigned starts[] = { b.randTagStart, b.barcodeStart, b.randPrimerStart, b.seqStart };
+    minLayoutStart = std::min( minLayoutStart, *std::min_element( starts, starts + 4 ) );
+  }
+  for ( size_t i = 0; maxShift > 0 && i < barcodeList.size(); ++i ) {
+    barcode & b = *barcodeList[ i ];
+    unsigned tailLength = std::min( b.ampPrimerLength, maxAnchorLength );
+    if ( tailLength < minAnchorLength ) {
+      continue;
+    }
+    std::string tail = b.ampPrimerString.substr( b.ampPrimerLength - tailLength );
+    unsigned tailEnd = b.ampPrimerStart + b.ampPrimerLength;
+    size_t a = 0;
+    while ( a < anchors.size() && ( anchors[ a ].tail != tail || anchors[ a ].tailEnd != tailEnd ) ) {
+      ++a;
+    }
+    if ( a < anchors.size() ) {
+      continue;
+    }
+    anchors.push_back( anchor() );
+    anchor & na = anchors.back();
+    na.tail = tail;
+    na.tailEnd = tailEnd;
+    na.windowStart = (long) tailEnd - tailLength - maxShift;
+    na.windowLength = tailLength + 2 * maxShift;
+    appendPeq( na.peq, tail );
+  }
+}
+
+void dmxPrimerAnchor::locate( const dmxView * seqs, size_t n, int * shifts ) const {
+  std::vector< unsigned > distance( n, maxAnchorDistance + 1 );
+  for ( size_t i = 0; i < n; ++i ) {
+    shifts[ i ] = 0;
+  }
+
+  const size_t laneCount = kernel->laneCount;
+  std::vector< unsigned short > columns;
+  unsigned short best[ dmxMyersKernel::maxLaneCount ], bestEnd[ dmxMyersKernel::maxLaneCount ];
+  for ( size_t a = 0; a < anchors.size(); ++a ) {
+    const anchor & an = anchors[ a ];
+    for ( size_t first = 0; first < n; first += laneCount ) {
+      size_t lanes = std::min( laneCount, n - first );
+      fillColumns( columns, laneCount, seqs, NULL, first, lanes, an.windowStart, an.windowLength );
+      kernel->block( &columns[ 0 ], an.windowLength, &an.peq[ 0 ], an.tail.size(), best, bestEnd );
+      for ( size_t lane = 0; lane < lanes; ++lane ) {
+        size_t i = first + lane;
+        // the primer ends just past the column where the best match ends;
+        // digest moves unsigned layout offsets by the shift, so none of them
+        // may end up before the read
+        long shift = an.windowStart + bestEnd[ lane ] + 1 - (long) an.tailEnd;
+        if ( best[ lane ] < distance[ i ] && shift >= -(long) minLayoutStart && shift <= (long) maxShift ) {
+          distance[ i ] = best[ lane ];
+          shifts[ i ] = shift;
+        }
+      }
+    }
+  }
+}
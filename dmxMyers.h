@@ -0,0 +1,156 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXMYERS_H_
+#define SANDBOX_JVD_APPS_DMX_DMXMYERS_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "dmxBarcode.h"
+#include "dmxMatcher.h"
+#include "dmxView.h"
+
+/*
+ * The Myers kernel this CPU runs best, picked once at run time: AVX2 matches
+ * 16 reads per batch, SSE4.1 8, and the scalar fallback one at a time.
+ */
+struct dmxMyersKernel {
+  typedef void ( * blockFunction )( const unsigned short * columns, size_t numColumns,
+      const unsigned char * peq, unsigned m, unsigned short * best, unsigned short * bestEnd );
+
+  static const size_t maxLaneCount = 16;
+
+  const char * name;
+  size_t laneCount;
+  blockFunction block;
+
+  static const dmxMyersKernel & select();
+};
+
+/*
+ * Indel tolerant barcode matching.  Each barcode is searched for, as an
+ * infix, in a window around its layout position padded by maxDistance bases
+ * on either side, using Myers' bit-vector edit distance with one 16-bit word
+ * per read.  Reads are matched in batches: with AVX2 the windows of 16 reads
+ * (8 with SSE4.1) sit in the lanes of one register and every barcode is run
+ * against all of them at once; otherwise reads are done one at a time.
+ * Barcodes are grouped by layout as in dmxLayoutMatcher, and the closest
+ * barcode over all groups wins, with ties reported as no match.
+ */
+class dmxMyersMatcher {
+
+  public:
+
+    // one machine word per lane holds the whole pattern
+    static const unsigned maxPatternLength = 16;
+
+    dmxMyersMatcher() : kernel( NULL ) { }
+
+    void build( const std::vector< barcode * > & barcodeList, unsigned _maxDistance );
+
+    // matches seqs[ 0 ] .. seqs[ n - 1 ], writing one result per read to
+    // out; with shifts, each read's layout is moved by its shift
+    void match( const dmxView * seqs, size_t n, dmxMatch * out, const int * shifts = NULL ) const;
+
+    dmxMatch match( const dmxView & seq, int shift = 0 ) const;
+
+  private:
+
+    struct group {
+      std::string layout;
+      size_t minReadLength;
+      unsigned windowStart, windowLength, patternLength;
+      // index in barcodeList of each of the group's barcodes
+      std::vector< int > barcodeIndex;
+      // per barcode, the pattern bits of each base: the low bytes of the
+      // A, C, G, T and N words in entries 0 to 4 and their high bytes in
+      // entries 8 to 12, laid out for a byte shuffle
+      std::vector< unsigned char > peq;
+    };
+
+    const dmxMyersKernel * kernel;
+    std::vector< group > groups;
+    unsigned maxDistance;
+    unsigned noMatchDistance;
+};
+
+/*
+ * Finds where the amplification primer actually ends in reads whose barcode
+ * was not found at its layout position, so the layout can be moved to match
+ * a small insertion or deletion upstream of the barcode.  The last (up to 16)
+ * bases of each distinct primer are searched for with the Myers kernel in a
+ * window reaching maxShift bases either side of where the layout puts them.
+ * A shift that would move the start of any layout (its random tag, barcode,
+ * random primer or sequence) to before the start of the read is not used.
+ */
+class dmxPrimerAnchor {
+
+  public:
+
+    static const unsigned maxAnchorLength = 16;
+    static const unsigned minAnchorLength = 8;
+    static const unsigned maxAnchorDistance = 2;
+
+    dmxPrimerAnchor() : kernel( NULL ), maxShift( 0 ), minLayoutStart( 0 ) { }
+
+    void build( const std::vector< barcode * > & barcodeList, unsigned _maxShift );
+
+    bool enabled() const { return maxShift > 0 && !anchors.empty(); }
+
+    // for each read, how far past its layout position the primer ends
+    // (negative if short of it, but never by more than minLayoutStart), or
+    // 0 if it could not be found
+    void locate( const dmxView * seqs, size_t n, int * shifts ) const;
+
+  private:
+
+    struct anchor {
+      std::string tail;
+      unsigned tailEnd;
+      long windowStart;
+      unsigned windowLength;
+      std::vector< unsigned char > peq;
+    };
+
+    const dmxMyersKernel * kernel;
+    std::vector< anchor > anchors;
+    unsigned maxShift;
+    // the earliest any layout part after the primer starts, over all barcodes
+    unsigned minLayoutStart;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXMYERS_H_
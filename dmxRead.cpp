@@ -34,61 +34,307 @@
 
 
 #include "dmxRead.h"
+#include "dmxWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+
+  void appendBases( uint64_t & tag, uint8_t & length, uint64_t & nMask, unsigned nShift,
+      const dmxView & s, size_t pos, size_t len ) {
+    size_t end = pos + len < s.size() ? pos + len : s.size();
+    for ( size_t i = pos; i < end; ++i ) {
+      uint64_t code;
+      switch ( s[ i ] ) {
+        case 'A': code = 0; break;
+        case 'C': code = 1; break;
+        case 'G': code = 2; break;
+        case 'T': code = 3; break;
+        default:
+          code = 0;
+          nMask |= (uint64_t) 1 << ( nShift + length );
+          break;
+      }
+      tag = ( tag << 2 ) | code;
+      ++length;
+    }
+  }
+
+  void tagBases( uint64_t tag, uint8_t length, uint64_t nMask, unsigned nShift, std::string & out ) {
+    static const char bases[] = "ACGT";
+    for ( unsigned i = 0; i < length; ++i ) {
+      if ( nMask & ( (uint64_t) 1 << ( nShift + i ) ) ) {
+        out += 'N';
+      }
+      else {
+        out += bases[ ( tag >> ( 2 * ( length - 1 - i ) ) ) & 3 ];
+      }
+    }
+  }
 
+  // Illumina 8-level binning of phred+33 qualities, and the score each bin
+  // is written back as
+  const char binScores[ 8 ] = { 33 + 2, 33 + 6, 33 + 15, 33 + 22, 33 + 27, 33 + 33, 33 + 37, 33 + 40 };
+
+  inline unsigned qualityBin( char c ) {
+    int q = (int) c - 33;
+    if ( q < 3 ) return 0;
+    if ( q < 10 ) return 1;
+    if ( q < 20 ) return 2;
+    if ( q < 25 ) return 3;
+    if ( q < 30 ) return 4;
+    if ( q < 35 ) return 5;
+    if ( q < 40 ) return 6;
+    return 7;
+  }
 
-dmxRead::dmxRead() {
-  groupSize = 0;
-  clusterSize = 0;
+  void packBases( const char * s, size_t length, dmxArena & arena, dmxSeqView & seq ) {
+    size_t baseBytes = dmxSeqView::packedBasesBytes( length );
+    bool anyN = false;
+    for ( size_t i = 0; i < length && !anyN; ++i ) {
+      char c = s[ i ];
+      anyN = c != 'A' && c != 'C' && c != 'G' && c != 'T';
+    }
+    size_t bytes = baseBytes + ( anyN ? dmxSeqView::nMaskBytes( length ) : 0 );
+    unsigned char * p = (unsigned char *) arena.allocate( bytes );
+    memset( p, 0, bytes );
+    unsigned char * nMask = p + baseBytes;
+    for ( size_t i = 0; i < length; ++i ) {
+      unsigned code;
+      switch ( s[ i ] ) {
+        case 'A': code = 0; break;
+        case 'C': code = 1; break;
+        case 'G': code = 2; break;
+        case 'T': code = 3; break;
+        default:
+          code = 0;
+          nMask[ i / 8 ] |= 1 << ( i % 8 );
+          break;
+      }
+      p[ i / 4 ] |= code << ( 2 * ( i % 4 ) );
+    }
+    seq.data = (const char *) p;
+    seq.length = length;
+    seq.encoding = anyN ? dmxSeqView::PACKED_BASES_N : dmxSeqView::PACKED_BASES;
+  }
+
+  void binQualities( const char * q, size_t length, dmxArena & arena, dmxSeqView & qual ) {
+    size_t bytes = dmxSeqView::binnedQualitiesBytes( length );
+    unsigned char * p = (unsigned char *) arena.allocate( bytes );
+    memset( p, 0, bytes );
+    for ( size_t i = 0; i < length; ++i ) {
+      p[ i / 2 ] |= qualityBin( q[ i ] ) << ( 4 * ( i % 2 ) );
+    }
+    qual.data = (const char *) p;
+    qual.length = length;
+    qual.encoding = dmxSeqView::BINNED_QUALITIES;
+  }
+
+  // copies s and q from start on into one allocation, or packs them
+  void storeMate( const dmxView & s, const dmxView & q, size_t start,
+      dmxArena & arena, dmxSeqView & seq, dmxSeqView & qual, bool compact ) {
+    size_t sLength = start < s.size() ? s.size() - start : 0;
+    size_t qLength = start < q.size() ? q.size() - start : 0;
+    if ( compact ) {
+      packBases( s.data() + start, sLength, arena, seq );
+      binQualities( q.data() + start, qLength, arena, qual );
+      return;
+    }
+    char * p = (char *) arena.allocate( sLength + qLength );
+    if ( sLength > 0 ) {
+      memcpy( p, s.data() + start, sLength );
+    }
+    if ( qLength > 0 ) {
+      memcpy( p + sLength, q.data() + start, qLength );
+    }
+    seq.data = p;
+    seq.length = sLength;
+    seq.encoding = dmxSeqView::PLAIN;
+    qual.data = p + sLength;
+    qual.length = qLength;
+    qual.encoding = dmxSeqView::PLAIN;
+  }
+
+  void borrowMate( const dmxView & s, const dmxView & q, size_t start, dmxSeqView & seq, dmxSeqView & qual ) {
+    dmxView sv = s.from( start );
+    dmxView qv = q.from( start );
+    seq.data = sv.data();
+    seq.length = sv.size();
+    seq.encoding = dmxSeqView::PLAIN;
+    qual.data = qv.data();
+    qual.length = qv.size();
+    qual.encoding = dmxSeqView::PLAIN;
+  }
 }
 
-dmxRead * dmxRead::newClone() {
-  dmxRead * clone = new dmxRead();
-  clone->fBCidx = fBCidx;
-  clone->rBCidx = rBCidx;
-  clone->tag = tag;
-  clone->fSeq = fSeq;
-  clone->rSeq = rSeq;
-  clone->fQual = fQual;
-  clone->rQual = rQual;
-  
-  clone->readID = readID;
+void dmxSeqView::appendTo( std::string & out ) const {
+  static const char bases[] = "ACGT";
+  const unsigned char * p = (const unsigned char *) data;
+  size_t at = out.size();
+  switch ( encoding ) {
+    case PACKED_BASES:
+    case PACKED_BASES_N:
+      out.resize( at + length );
+      for ( size_t i = 0; i < length; ++i ) {
+        out[ at + i ] = bases[ ( p[ i / 4 ] >> ( 2 * ( i % 4 ) ) ) & 3 ];
+      }
+      if ( encoding == PACKED_BASES_N ) {
+        const unsigned char * nMask = p + packedBasesBytes( length );
+        for ( size_t i = 0; i < length; ++i ) {
+          if ( nMask[ i / 8 ] & ( 1 << ( i % 8 ) ) ) {
+            out[ at + i ] = 'N';
+          }
+        }
+      }
+      break;
+    case BINNED_QUALITIES:
+      out.resize( at + length );
+      for ( size_t i = 0; i < length; ++i ) {
+        out[ at + i ] = binScores[ ( p[ i / 2 ] >> ( 4 * ( i % 2 ) ) ) & 15 ];
+      }
+      break;
+    default:
+      out.append( data, length );
+      break;
+  }
+}
+
+size_t dmxSeqView::bytes() const {
+  switch ( encoding ) {
+    case PACKED_BASES: return packedBasesBytes( length );
+    case PACKED_BASES_N: return packedBasesBytes( length ) + nMaskBytes( length );
+    case BINNED_QUALITIES: return binnedQualitiesBytes( length );
+    default: return length;
+  }
+}
+
+namespace {
+
+  struct kmerCounter {
+    double * counts;
+    void operator()( uint64_t code ) { counts[ code ] += 1; }
+  };
+}
+
+void dmxSeqView::countKmers( unsigned k, double * counts ) const {
+  kmerCounter count;
+  count.counts = counts;
+  forEachKmer( k, count );
+}
+
+std::string dmxSeqView::str() const {
+  std::string out;
+  appendTo( out );
+  return out;
+}
+
+void dmxReadKey::appendFwd( const dmxView & s, size_t pos, size_t len ) {
+  appendBases( fTag, fLength, nMask, 0, s, pos, len );
+}
+
+void dmxReadKey::appendRev( const dmxView & s, size_t pos, size_t len ) {
+  appendBases( rTag, rLength, nMask, maxTagLength, s, pos, len );
+}
 
-  clone->descriptionCode = descriptionCode;
-  clone->groupSize = groupSize;
-  clone->clusterSize = clusterSize;
-  return clone;
+std::string dmxReadKey::tagString() const {
+  std::string out;
+  out.reserve( fLength + rLength );
+  appendTagString( out );
+  return out;
 }
 
-dmxRead::dmxRead( barcodeAssignmentType _descriptionCode, std::string _tag, unsigned _readID ) {
+void dmxReadKey::appendTagString( std::string & out ) const {
+  tagBases( fTag, fLength, nMask, 0, out );
+  tagBases( rTag, rLength, nMask, maxTagLength, out );
+}
+
+size_t dmxReadKey::hash() const {
+  // 64-bit mix of each field in turn
+  uint64_t h = fTag * 0x9E3779B97F4A7C15ULL;
+  h ^= ( rTag + 0x632BE59BD9B4E019ULL + ( h << 6 ) + ( h >> 2 ) ) * 0xC2B2AE3D27D4EB4FULL;
+  h ^= ( nMask + ( h << 6 ) + ( h >> 2 ) ) * 0x165667B19E3779F9ULL;
+  h ^= ( (uint64_t) (uint16_t) fBCidx << 48 ) | ( (uint64_t) (uint16_t) rBCidx << 32 ) | ( (uint64_t) fLength << 8 ) | rLength;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  return (size_t) h;
+}
+
+
+dmxRead::dmxRead() {
+  groupSize = 0;
+  clusterSize = 0;
+  support = NULL;
+}
+
+dmxRead::dmxRead( barcodeAssignmentType _descriptionCode, const dmxReadKey & _key, unsigned _readID ) {
   descriptionCode = _descriptionCode;
-  tag = _tag;
+  key = _key;
   readID = _readID;
   groupSize = 0;
   clusterSize = 0;
+  support = NULL;
 }
 
-void dmxRead::fwd( int _fBCidx, std::string _fSeq ) {
-  fBCidx = _fBCidx;
-  fSeq = _fSeq;
-  fQual.assign( _fSeq.length(), 'J' );
+dmxRead * dmxRead::create( dmxArena & arena, barcodeAssignmentType _descriptionCode, const dmxReadKey & _key, unsigned _readID ) {
+  return new ( arena.allocate( sizeof( dmxRead ) ) ) dmxRead( _descriptionCode, _key, _readID );
 }
 
-void dmxRead::rev( int _rBCidx, std::string _rSeq ) {
-  rBCidx = _rBCidx;
-  rSeq = _rSeq;
-  rQual.assign( _rSeq.length(), 'J' );
+dmxRead * dmxRead::newClone( dmxArena & arena ) {
+  return new ( arena.allocate( sizeof( dmxRead ) ) ) dmxRead( *this );
 }
 
-void dmxRead::fwd( int _fBCidx, std::string _fSeq, std::string _fQual ) {
-  fBCidx = _fBCidx;
-  fSeq = _fSeq;
-  fQual = _fQual;
+dmxRead * dmxRead::newCopy( dmxArena & arena ) {
+  dmxRead * r = newClone( arena );
+  dmxSeqView * views[ 4 ] = { &r->fSeq, &r->fQual, &r->rSeq, &r->rQual };
+  for ( int v = 0; v < 4; ++v ) {
+    views[ v ]->data = arena.copy( views[ v ]->data, views[ v ]->bytes() );
+  }
+  if ( support != NULL ) {
+    size_t bytes = ( fSeq.size() + rSeq.size() ) * sizeof( uint16_t );
+    r->support = (uint16_t *) arena.allocate( bytes );
+    memcpy( r->support, support, bytes );
+  }
+  return r;
 }
 
-void dmxRead::rev( int _rBCidx, std::string _rSeq, std::string _rQual ) {
-  rBCidx = _rBCidx;
-  rSeq = _rSeq;
-  rQual = _rQual;
+void dmxRead::setSupport( const std::vector< unsigned > & fSupport, const std::vector< unsigned > & rSupport, dmxArena & arena ) {
+  support = (uint16_t *) arena.allocate( ( fSeq.size() + rSeq.size() ) * sizeof( uint16_t ) );
+  for ( size_t i = 0; i < fSeq.size(); ++i ) {
+    support[ i ] = i < fSupport.size() ? std::min( fSupport[ i ], 65535u ) : 0;
+  }
+  for ( size_t i = 0; i < rSeq.size(); ++i ) {
+    support[ fSeq.size() + i ] = i < rSupport.size() ? std::min( rSupport[ i ], 65535u ) : 0;
+  }
+}
+
+void dmxRead::fwd( int _fBCidx, const dmxView & _fSeq, dmxArena & arena ) {
+  fwd( _fBCidx, _fSeq, std::string( _fSeq.size(), 'J' ), 0, arena );
+}
+
+void dmxRead::rev( int _rBCidx, const dmxView & _rSeq, dmxArena & arena ) {
+  rev( _rBCidx, _rSeq, std::string( _rSeq.size(), 'J' ), 0, arena );
+}
+
+void dmxRead::fwd( int _fBCidx, const dmxView & _fSeq, const dmxView & _fQual, size_t start, dmxArena & arena, bool compact ) {
+  key.fBCidx = _fBCidx;
+  storeMate( _fSeq, _fQual, start, arena, fSeq, fQual, compact );
+}
+
+void dmxRead::rev( int _rBCidx, const dmxView & _rSeq, const dmxView & _rQual, size_t start, dmxArena & arena, bool compact ) {
+  key.rBCidx = _rBCidx;
+  storeMate( _rSeq, _rQual, start, arena, rSeq, rQual, compact );
+}
+
+void dmxRead::borrowFwd( int _fBCidx, const dmxView & _fSeq, const dmxView & _fQual, size_t start ) {
+  key.fBCidx = _fBCidx;
+  borrowMate( _fSeq, _fQual, start, fSeq, fQual );
+}
+
+void dmxRead::borrowRev( int _rBCidx, const dmxView & _rSeq, const dmxView & _rQual, size_t start ) {
+  key.rBCidx = _rBCidx;
+  borrowMate( _rSeq, _rQual, start, rSeq, rQual );
 }
 
 std::string dmxRead::getDescription() {
@@ -133,7 +379,7 @@ void dmxRead::print() {
 
   std::cout 
     << description << " " 
-    << tag << " " 
+    << key.tagString() << " " 
     << readID << " " 
     << getFwdBCidx() << " " 
     << fSeq << " " 
@@ -144,154 +390,159 @@ void dmxRead::print() {
     << std::endl;
 }
 
-void dmxRead::printFFasta( unsigned i, std::ofstream & fh ) {
-
-  std::string description = getShortDescription();
-
-  fh 
-    << ">"
-    << description << "_" << i << "_1 " 
-    << tag << " " 
-    << readID << " " 
-    << getFwdBCidx()
-    << " groupSize " << groupSize
-    << " clusterSize " << clusterSize
-    << std::endl 
-    << fSeq 
-    << std::endl;
+void dmxRead::formatHeader( char marker, unsigned i, char mate, int BCidx, std::string & out ) {
+  out += marker;
+  out += getShortDescription();
+  out += '_';
+  appendUnsigned( out, i );
+  out += '_';
+  out += mate;
+  out += ' ';
+  key.appendTagString( out );
+  out += ' ';
+  appendUnsigned( out, readID );
+  out += ' ';
+  appendInt( out, BCidx );
+  out += " groupSize ";
+  appendUnsigned( out, groupSize );
+  out += " clusterSize ";
+  appendUnsigned( out, clusterSize );
+  if ( support != NULL ) {
+    // the support of each consensus base of this mate
+    const uint16_t * counts = mate == '1' ? support : support + fSeq.size();
+    size_t n = mate == '1' ? fSeq.size() : rSeq.size();
+    out += " support ";
+    for ( size_t c = 0; c < n; ++c ) {
+      if ( c > 0 ) {
+        out += ',';
+      }
+      appendUnsigned( out, counts[ c ] );
+    }
+  }
+  out += '\n';
 }
 
-void dmxRead::printRFasta( unsigned i, std::ofstream & fh ) {
-
-  std::string description = getShortDescription();
-
-  fh
-    << ">"
-    << description << "_" << i << "_2 " 
-    << tag << " " 
-    << readID << " " 
-    << getRevBCidx()
-    << " groupSize " << groupSize
-    << " clusterSize " << clusterSize
-    << std::endl
-    << rSeq 
-    << std::endl;
+void dmxRead::formatFFasta( unsigned i, std::string & out ) {
+  formatHeader( '>', i, '1', getFwdBCidx(), out );
+  fSeq.appendTo( out );
+  out += '\n';
 }
 
-void dmxRead::printFFastq( unsigned i, std::ofstream & fh ) {
-
-  std::string description = getShortDescription();
-
-  fh 
-    << "@"
-    << description << "_" << i << "_1 " 
-    << tag << " " 
-    << readID << " " 
-    << getFwdBCidx()
-    << " groupSize " << groupSize
-    << " clusterSize " << clusterSize
-    << std::endl 
-    << fSeq
-    << std::endl << "+" << std::endl
-    << fQual
-    << std::endl;
+void dmxRead::formatRFasta( unsigned i, std::string & out ) {
+  formatHeader( '>', i, '2', getRevBCidx(), out );
+  rSeq.appendTo( out );
+  out += '\n';
 }
 
-void dmxRead::printRFastq( unsigned i, std::ofstream & fh ) {
-
-  std::string description = getShortDescription();
-
-  fh
-    << "@"
-    << description << "_" << i << "_2 " 
-    << tag << " " 
-    << readID << " " 
-    << getRevBCidx()
-    << " groupSize " << groupSize
-    << " clusterSize " << clusterSize
-    << std::endl
-    << rSeq 
-    << std::endl << "+" << std::endl
-    << rQual
-    << std::endl;
+void dmxRead::formatFFastq( unsigned i, std::string & out ) {
+  formatHeader( '@', i, '1', getFwdBCidx(), out );
+  fSeq.appendTo( out );
+  out += "\n+\n";
+  fQual.appendTo( out );
+  out += '\n';
 }
 
-void dmxRead::printFasta( unsigned i, std::ofstream & fh ) {
-  printFFasta( i, fh );
-  printRFasta( i, fh );
+void dmxRead::formatRFastq( unsigned i, std::string & out ) {
+  formatHeader( '@', i, '2', getRevBCidx(), out );
+  rSeq.appendTo( out );
+  out += "\n+\n";
+  rQual.appendTo( out );
+  out += '\n';
 }
 
-void dmxRead::printFastq( unsigned i, std::ofstream & fh ) {
-  printFFastq( i, fh );
-  printRFastq( i, fh );
+void dmxRead::formatFasta( unsigned i, std::string & out ) {
+  formatFFasta( i, out );
+  formatRFasta( i, out );
 }
 
-void dmxRead::getDinucleotideFreqs( std::vector< double > & kmer ) {
-  std::vector< double > fkmer, rkmer;
-  getDinucleotideFreqs( fSeq, fkmer );
-  kmer.insert( kmer.begin(), fkmer.begin(), fkmer.end() );
-  getDinucleotideFreqs( rSeq, rkmer );
-  kmer.insert( kmer.end(), rkmer.begin(), rkmer.end() );
+void dmxRead::formatFastq( unsigned i, std::string & out ) {
+  formatFFastq( i, out );
+  formatRFastq( i, out );
 }
 
-void dmxRead::getDinucleotideFreqs( std::string s, std::vector< double > & kmer ) {
+namespace {
 
-  std::map< std::string, int > counts;
-  counts["AA"]=0;counts["AC"]=0;counts["AG"]=0;counts["AT"]=0;
-  counts["CA"]=0;counts["CC"]=0;counts["CG"]=0;counts["CT"]=0;
-  counts["GA"]=0;counts["GC"]=0;counts["GG"]=0;counts["GT"]=0;
-  counts["TA"]=0;counts["TC"]=0;counts["TG"]=0;counts["TT"]=0;
+  // record layout: length, key, code, readID, groupSize, clusterSize, then
+  // for fSeq, fQual, rSeq, rQual their encoding, length and bytes
+  const size_t recordKeyOffset = sizeof( uint32_t );
+  const size_t recordHeaderBytes = recordKeyOffset + sizeof( dmxReadKey ) + 1 + sizeof( uint32_t ) + 2 * sizeof( uint16_t );
+  const size_t viewHeaderBytes = 1 + sizeof( uint32_t );
 
-  for ( size_t i = 1; i < s.size(); ++i ) {
-    counts[ s.substr( i - 1, 1 ) ]++;
+  template< typename T >
+  inline void put( std::string & out, size_t & at, T v ) {
+    memcpy( &out[ at ], &v, sizeof( T ) );
+    at += sizeof( T );
   }
 
-  for ( std::map< std::string, int >::iterator it = counts.begin(); it != counts.end(); ++it ) {
-    kmer.push_back( (double) (*it).second );
+  template< typename T >
+  inline T get( const char * & p ) {
+    T v;
+    memcpy( &v, p, sizeof( T ) );
+    p += sizeof( T );
+    return v;
   }
 }
 
-bool dmxRead::operator== ( dmxRead & other ) {
-
-  enum cmp { LT, EQ, GT };
-
-  if (descriptionCode != other.descriptionCode) {
-    std::cout << "Trying to compare " << descriptionCode << " to " << other.descriptionCode << " in read sort." << std::endl;
+void dmxRead::appendRecord( std::string & out ) {
+  const dmxSeqView * views[ 4 ] = { &fSeq, &fQual, &rSeq, &rQual };
+  size_t bytes = recordHeaderBytes;
+  for ( int v = 0; v < 4; ++v ) {
+    bytes += viewHeaderBytes + views[ v ]->bytes();
   }
-
-  cmp fCmp = EQ;
-  cmp rCmp = EQ;
-
-  if ( descriptionCode != REV ) {
-    if ( getFwdBCidx() < other.getFwdBCidx() ) {
-      fCmp = LT;
-    }
-    else if ( getFwdBCidx() > other.getFwdBCidx() ) {
-      fCmp = GT;
-    }
-  }
-  if ( descriptionCode != FWD ) {
-    if ( getRevBCidx() < other.getRevBCidx() ) {
-      rCmp = LT;
-    }
-    else if ( getRevBCidx() > other.getRevBCidx() ) {
-      rCmp = GT;
+  size_t at = out.size();
+  out.resize( at + bytes );
+  put< uint32_t >( out, at, bytes );
+  put< dmxReadKey >( out, at, key );
+  put< char >( out, at, descriptionCode );
+  put< uint32_t >( out, at, readID );
+  put< uint16_t >( out, at, groupSize );
+  put< uint16_t >( out, at, clusterSize );
+  for ( int v = 0; v < 4; ++v ) {
+    put< uint8_t >( out, at, views[ v ]->encoding );
+    put< uint32_t >( out, at, views[ v ]->length );
+    size_t n = views[ v ]->bytes();
+    if ( n > 0 ) {
+      memcpy( &out[ at ], views[ v ]->data, n );
+      at += n;
     }
   }
+}
 
-  switch (fCmp) {
-    case LT:
-      return false;
-    case GT:
-      return false;
-    default:
-      switch (rCmp) {
-        case LT:
-          return false;
-        case GT:
-          return false;
-        default:
-          return tag == other.tag;
-      }
+uint32_t dmxRead::recordBytes( const char * record ) {
+  return get< uint32_t >( record );
+}
+
+void dmxRead::recordKey( const char * record, dmxReadKey & key ) {
+  record += recordKeyOffset;
+  key = get< dmxReadKey >( record );
+}
+
+dmxRead * dmxRead::fromRecord( dmxArena & arena, const char * record ) {
+  const char * p = record + recordKeyOffset;
+  dmxReadKey key = get< dmxReadKey >( p );
+  barcodeAssignmentType code = get< char >( p );
+  unsigned id = get< uint32_t >( p );
+  dmxRead * r = create( arena, code, key, id );
+  r->groupSize = get< uint16_t >( p );
+  r->clusterSize = get< uint16_t >( p );
+  dmxSeqView * views[ 4 ] = { &r->fSeq, &r->fQual, &r->rSeq, &r->rQual };
+  for ( int v = 0; v < 4; ++v ) {
+    views[ v ]->encoding = get< uint8_t >( p );
+    views[ v ]->length = get< uint32_t >( p );
+    size_t n = views[ v ]->bytes();
+    views[ v ]->data = arena.copy( p, n );
+    p += n;
   }
+  return r;
+}
+
+void dmxRead::getKmerProfile( unsigned k, double * profile ) {
+  size_t n = kmerProfileSize( k ) / 2;
+  std::fill( profile, profile + 2 * n, 0.0 );
+  fSeq.countKmers( k, profile );
+  rSeq.countKmers( k, profile + n );
+}
+
+bool dmxRead::operator== ( dmxRead & other ) {
+  return key == other.key;
 }
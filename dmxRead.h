@@ -44,6 +44,9 @@
 #include <fstream>
 #include <stdint.h>
 
+#include "dmxArena.h"
+#include "dmxView.h"
+
 //#include <snappy.h>
 
 //enum barcodeAssignmentType { BOTH, FWD, REV, NO_MATCH, MISMATCH } ;
@@ -56,13 +59,152 @@
 
 typedef char barcodeAssignmentType;
 
+/*
+ * The key reads are grouped on: the barcodes of both mates, and the random
+ * tag, random primer and first bases of sequence of each mate packed 2 bits
+ * per base.  Bases other than ACGT pack as A and are flagged in nMask (bit i
+ * for forward base i, bit 32 + i for reverse base i).  A mate without a
+ * barcode has index -1 and an empty tag.
+ */
+struct dmxReadKey {
+
+  static const unsigned maxTagLength = 32;
+
+  uint64_t fTag, rTag;
+  uint64_t nMask;
+  int16_t fBCidx, rBCidx;
+  uint8_t fLength, rLength;
+
+  dmxReadKey() : fTag( 0 ), rTag( 0 ), nMask( 0 ), fBCidx( -1 ), rBCidx( -1 ), fLength( 0 ), rLength( 0 ) { }
+
+  // append s[ pos, pos + len ) (cut short at the end of s) to a mate's tag
+  void appendFwd( const dmxView & s, size_t pos, size_t len );
+  void appendRev( const dmxView & s, size_t pos, size_t len );
+
+  // the tag as bases, forward then reverse
+  std::string tagString() const;
+  void appendTagString( std::string & out ) const;
+
+  size_t hash() const;
+
+  bool operator== ( const dmxReadKey & other ) const {
+    return fTag == other.fTag && rTag == other.rTag && nMask == other.nMask &&
+      fBCidx == other.fBCidx && rBCidx == other.rBCidx &&
+      fLength == other.fLength && rLength == other.rLength;
+  }
+
+  bool operator< ( const dmxReadKey & other ) const {
+    if ( fBCidx != other.fBCidx ) return fBCidx < other.fBCidx;
+    if ( rBCidx != other.rBCidx ) return rBCidx < other.rBCidx;
+    if ( fLength != other.fLength ) return fLength < other.fLength;
+    if ( fTag != other.fTag ) return fTag < other.fTag;
+    if ( rLength != other.rLength ) return rLength < other.rLength;
+    if ( rTag != other.rTag ) return rTag < other.rTag;
+    return nMask < other.nMask;
+  }
+};
+
+// hash and equality for tbb::concurrent_hash_map
+struct dmxReadKeyHashCompare {
+  static size_t hash( const dmxReadKey & k ) { return k.hash(); }
+  static bool equal( const dmxReadKey & a, const dmxReadKey & b ) { return a == b; }
+};
+
+/*
+ * Bases or qualities of one mate, held in the arena of the read.  Compact
+ * reads pack bases 2 bits each, A C G T, with a bit mask of the positions
+ * that were anything else (written back as N) only when there are any; and
+ * qualities in 4 bits each as one of 8 Illumina-style bins.  str() and <<
+ * decode, so length is always in bases.
+ */
+struct dmxSeqView {
+  enum encodingType { PLAIN, PACKED_BASES, PACKED_BASES_N, BINNED_QUALITIES };
+
+  const char * data;
+  uint32_t length;
+  uint8_t encoding;
+
+  dmxSeqView() : data( NULL ), length( 0 ), encoding( PLAIN ) { }
+
+  size_t size() const { return length; }
+  // bytes data takes up in its encoding
+  size_t bytes() const;
+  // calls visit( code ) for each k-mer (k up to 32) in order, its bases 2
+  // bits each (A C G T) first base highest; k-mers with a base other than
+  // ACGT are skipped
+  template< typename Visitor >
+  void forEachKmer( unsigned k, Visitor & visit ) const;
+  // adds one to counts[ code ] for each k-mer
+  void countKmers( unsigned k, double * counts ) const;
+
+  static unsigned baseCode( unsigned char c ) {
+    switch ( c ) {
+      case 'A': return 0;
+      case 'C': return 1;
+      case 'G': return 2;
+      case 'T': return 3;
+      default: return 4;
+    }
+  }
+  std::string str() const;
+  void appendTo( std::string & out ) const;
+
+  // bytes the encoded form of length bases or qualities takes up
+  static size_t packedBasesBytes( size_t length ) { return ( length + 3 ) / 4; }
+  static size_t nMaskBytes( size_t length ) { return ( length + 7 ) / 8; }
+  static size_t binnedQualitiesBytes( size_t length ) { return ( length + 1 ) / 2; }
+};
+
+template< typename Visitor >
+void dmxSeqView::forEachKmer( unsigned k, Visitor & visit ) const {
+  // the code of the last k bases rolls along, and a k-mer is visited once k
+  // bases in a row are ACGT
+  const uint64_t mask = k < 32 ? ( (uint64_t) 1 << ( 2 * k ) ) - 1 : ~(uint64_t) 0;
+  const unsigned char * p = (const unsigned char *) data;
+  uint64_t code = 0;
+  unsigned run = 0;
+  if ( encoding == PLAIN ) {
+    for ( size_t i = 0; i < length; ++i ) {
+      unsigned b = baseCode( p[ i ] );
+      if ( b > 3 ) {
+        run = 0;
+        continue;
+      }
+      code = ( ( code << 2 ) | b ) & mask;
+      if ( ++run >= k ) {
+        visit( code );
+      }
+    }
+    return;
+  }
+  const unsigned char * nMask = encoding == PACKED_BASES_N ? p + packedBasesBytes( length ) : NULL;
+  for ( size_t i = 0; i < length; ++i ) {
+    if ( nMask != NULL && ( nMask[ i / 8 ] & ( 1 << ( i % 8 ) ) ) ) {
+      run = 0;
+      continue;
+    }
+    code = ( ( code << 2 ) | ( ( p[ i / 4 ] >> ( 2 * ( i % 4 ) ) ) & 3 ) ) & mask;
+    if ( ++run >= k ) {
+      visit( code );
+    }
+  }
+}
+
+inline std::ostream & operator<< ( std::ostream & os, const dmxSeqView & v ) {
+  if ( v.encoding == dmxSeqView::PLAIN ) {
+    return os.write( v.data, v.length );
+  }
+  return os << v.str();
+}
+
+/*
+ * Reads live in a dmxArena along with their bases and qualities, and are
+ * never deleted one by one: the arena is released once the reads are written.
+ */
 class dmxRead {
 
 private:
 
-  short int fBCidx;
-  short int rBCidx;
-
   barcodeAssignmentType descriptionCode;
 
   unsigned readID;
@@ -73,23 +215,41 @@ private:
    */
   uint16_t groupSize, clusterSize;
 
+  /*
+   * for a consensus read, the number of reads that agree with each of its
+   * bases, forward mate then reverse mate; NULL for any other read
+   */
+  uint16_t * support;
+
+  void formatHeader( char marker, unsigned i, char mate, int BCidx, std::string & out );
+
 public:
 
   /*
-   * Constructors, Destructor, clone methods
+   * Constructors, clone methods
    */
   dmxRead();
-  dmxRead * newClone();
-  dmxRead( barcodeAssignmentType _descriptionCode, std::string _tag, unsigned _readID );
+  dmxRead( barcodeAssignmentType _descriptionCode, const dmxReadKey & _key, unsigned _readID );
+  static dmxRead * create( dmxArena & arena, barcodeAssignmentType _descriptionCode, const dmxReadKey & _key, unsigned _readID );
+  // the clone shares the bases and qualities, so it belongs in the same arena
+  dmxRead * newClone( dmxArena & arena );
+  // the copy has its own bases and qualities in arena
+  dmxRead * newCopy( dmxArena & arena );
  
   /*
-   * Initialization/Set methods
+   * Initialization/Set methods; each mate is copied into arena from start
+   * on, compact or as is
    */
-  void fwd( int _fBCidx, std::string _fSeq );
-  void rev( int _rBCidx, std::string _rSeq );
+  void fwd( int _fBCidx, const dmxView & _fSeq, dmxArena & arena );
+  void rev( int _rBCidx, const dmxView & _rSeq, dmxArena & arena );
+
+  void fwd( int _fBCidx, const dmxView & _fSeq, const dmxView & _fQual, size_t start, dmxArena & arena, bool compact = false );
+  void rev( int _rBCidx, const dmxView & _rSeq, const dmxView & _rQual, size_t start, dmxArena & arena, bool compact = false );
 
-  void fwd( int _fBCidx, std::string _fSeq, std::string _fQual );
-  void rev( int _rBCidx, std::string _rSeq, std::string _rQual );
+  // borrow the mate from start on instead of copying it, for a read written
+  // out while its input is still there
+  void borrowFwd( int _fBCidx, const dmxView & _fSeq, const dmxView & _fQual, size_t start );
+  void borrowRev( int _rBCidx, const dmxView & _rSeq, const dmxView & _rQual, size_t start );
    
   /*
    * Access/Get methods
@@ -98,15 +258,20 @@ public:
   std::string getDescription();
   std::string getShortDescription();
 
-  void getDinucleotideFreqs( std::vector< double > & kmer );
-  void getDinucleotideFreqs( std::string s, std::vector< double > & kmer );
+  // k-mer counts of the forward mate then the reverse mate, written over
+  // the kmerProfileSize( k ) values at profile
+  static size_t kmerProfileSize( unsigned k ) { return (size_t) 2 << ( 2 * k ); }
+  void getKmerProfile( unsigned k, double * profile );
 
-  int getFwdBCidx() { return fBCidx; }
-  int getRevBCidx() { return rBCidx; }
+  int getFwdBCidx() { return key.fBCidx; }
+  int getRevBCidx() { return key.rBCidx; }
   int get_readID() { return readID; }
 
   void setGroupSize( int _groupSize ) { groupSize = _groupSize; }
   void setClusterSize( int _clusterSize ) { clusterSize = _clusterSize; }
+  // support counts (capped at 65535) for each base of the mates as they are
+  // now, kept in arena
+  void setSupport( const std::vector< unsigned > & fSupport, const std::vector< unsigned > & rSupport, dmxArena & arena );
 
   /*
    * Operators
@@ -114,57 +279,38 @@ public:
   bool operator== ( dmxRead & other );
 
   /*
-   * Printing and debugging
+   * Printing and debugging; the format methods append the record for the
+   * i-th read of its category to out
    */
   void print();
-  void printFFasta( unsigned i, std::ofstream & fh );
-  void printRFasta( unsigned i, std::ofstream & fh );
-  void printFFastq( unsigned i, std::ofstream & fh );
-  void printRFastq( unsigned i, std::ofstream & fh );
-  void printFasta( unsigned i, std::ofstream & fh );
-  void printFastq( unsigned i, std::ofstream & fh );
+  void formatFFasta( unsigned i, std::string & out );
+  void formatRFasta( unsigned i, std::string & out );
+  void formatFFastq( unsigned i, std::string & out );
+  void formatRFastq( unsigned i, std::string & out );
+  void formatFasta( unsigned i, std::string & out );
+  void formatFastq( unsigned i, std::string & out );
+
+  /*
+   * Spill records: the read with its bases and qualities as one record
+   * starting with its length in bytes.  Fields are in host layout, since
+   * only the process that wrote a record reads it back.  Only digested reads
+   * are spilled, so consensus support is not kept.
+   */
+  void appendRecord( std::string & out );
+  static uint32_t recordBytes( const char * record );
+  static void recordKey( const char * record, dmxReadKey & key );
+  static dmxRead * fromRecord( dmxArena & arena, const char * record );
 
   //TODO Eventually all data members below should be private TODO//
 
-  std::string tag;
-  std::string fSeq, rSeq;
-  std::string fQual, rQual;
+  dmxReadKey key;
+  dmxSeqView fSeq, rSeq;
+  dmxSeqView fQual, rQual;
 };
 
 struct dmxReadCompare {
-  
-  enum cmp { LT, EQ, GT };
-
   bool operator() ( dmxRead * x, dmxRead * y ) const {
-    if ( x->getDescriptionCode() != y->getDescriptionCode() ) {
-      std::cout << "Trying to compare " << x->getDescriptionCode() << " to " << y->getDescriptionCode() << " in read sort." << std::endl;
-    }
-    cmp fCmp = EQ;
-    cmp rCmp = EQ;
-    if ( x->getDescriptionCode() != REV ) {
-      if ( x->getFwdBCidx() < y->getFwdBCidx() ) { fCmp = LT; }
-      else if ( x->getFwdBCidx() > y->getFwdBCidx() ) { fCmp = GT; }
-    }
-    if ( x->getDescriptionCode() != FWD ) {
-      if ( x->getRevBCidx() < y->getRevBCidx() ) { rCmp = LT; }
-      else if ( x->getRevBCidx() > y->getRevBCidx() ) { rCmp = GT; }
-    }
-    switch (fCmp) {
-      case LT:
-        return true;
-      case GT:
-        return false;
-      default:
-        switch (rCmp) {
-          case LT:
-            return true;
-          case EQ:
-            return x->tag < y->tag;
-          default:
-            return false;
-        }
-        return false;
-    }
+    return x->key < y->key;
   }
 };
 
@@ -0,0 +1,184 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXRING_H_
+#define SANDBOX_JVD_APPS_DMX_DMXRING_H_
+
+#include <cstddef>
+#include <vector>
+#include <pthread.h>
+
+#include <tbb/tbb.h>
+
+/*
+ * Bounded single-producer/single-consumer ring.  push and pop are lock free
+ * while there is room/data; a side that finds the ring full/empty spins
+ * briefly and then sleeps on a condition variable until the other side moves.
+ * The producer and consumer indices live on separate cache lines so the two
+ * threads do not false-share.
+ */
+template < typename T >
+class dmxSpscRing {
+
+  public:
+
+    static const size_t cacheLine = 64;
+    static const int spinLimit = 256;
+
+    dmxSpscRing( size_t capacity ) : slots( capacity + 1 ) {
+      head = 0;
+      tail = 0;
+      closed = false;
+      producerWaiting = false;
+      consumerWaiting = false;
+      producerHead = 0;
+      consumerTail = 0;
+      pthread_mutex_init( &mutex, NULL );
+      pthread_cond_init( &notFull, NULL );
+      pthread_cond_init( &notEmpty, NULL );
+    }
+
+    ~dmxSpscRing() {
+      pthread_cond_destroy( &notEmpty );
+      pthread_cond_destroy( &notFull );
+      pthread_mutex_destroy( &mutex );
+    }
+
+    // producer side: blocks while the ring is full
+    void push( const T & t ) {
+      size_t t0 = tail;
+      size_t t1 = advance( t0 );
+      if ( t1 == producerHead ) {
+        producerHead = head;
+        if ( t1 == producerHead ) {
+          waitFor( producerWaiting, notFull, t1, true );
+          producerHead = head;
+        }
+      }
+      slots[ t0 ] = t;
+      // fetch_and_store is a full fence, pairing with the waiting flag check below
+      tail.fetch_and_store( t1 );
+      wake( consumerWaiting, notEmpty );
+    }
+
+    // consumer side: blocks while the ring is empty; false once the producer
+    // has closed the ring and everything pushed before that has been popped
+    bool pop( T & t ) {
+      size_t h = head;
+      if ( h == consumerTail ) {
+        consumerTail = tail;
+        if ( h == consumerTail ) {
+          if ( !waitFor( consumerWaiting, notEmpty, h, false ) ) {
+            return false;
+          }
+          consumerTail = tail;
+        }
+      }
+      t = slots[ h ];
+      head.fetch_and_store( advance( h ) );
+      wake( producerWaiting, notFull );
+      return true;
+    }
+
+    // producer side: no more pushes will follow
+    void close() {
+      closed.fetch_and_store( true );
+      wake( consumerWaiting, notEmpty );
+    }
+
+  private:
+
+    dmxSpscRing( const dmxSpscRing & );
+    dmxSpscRing & operator=( const dmxSpscRing & );
+
+    size_t advance( size_t i ) const {
+      return ( i + 1 == slots.size() ) ? 0 : i + 1;
+    }
+
+    // producer: wait until head moves off 'blocked'; consumer: wait until tail
+    // moves off 'blocked' or the ring is closed.  Returns false only for a
+    // consumer that found the ring closed and drained.
+    bool waitFor( tbb::atomic< bool > & waiting, pthread_cond_t & cond, size_t blocked, bool producer ) {
+      for ( int i = 0; i < spinLimit; ++i ) {
+        if ( producer ? ( head != blocked ) : ( tail != blocked ) ) {
+          return true;
+        }
+      }
+      bool ready = true;
+      pthread_mutex_lock( &mutex );
+      waiting.fetch_and_store( true );
+      for ( ; ; ) {
+        if ( producer ? ( head != blocked ) : ( tail != blocked ) ) {
+          break;
+        }
+        if ( !producer && closed ) {
+          // the final push happens before close, so re-check tail once more
+          ready = ( tail != blocked );
+          break;
+        }
+        pthread_cond_wait( &cond, &mutex );
+      }
+      waiting = false;
+      pthread_mutex_unlock( &mutex );
+      return ready;
+    }
+
+    void wake( tbb::atomic< bool > & waiting, pthread_cond_t & cond ) {
+      if ( waiting ) {
+        pthread_mutex_lock( &mutex );
+        pthread_cond_signal( &cond );
+        pthread_mutex_unlock( &mutex );
+      }
+    }
+
+    std::vector< T > slots;
+    char slotsPad[ cacheLine ];
+
+    // written by the consumer
+    tbb::atomic< size_t > head;
+    size_t consumerTail;
+    char consumerPad[ cacheLine ];
+
+    // written by the producer
+    tbb::atomic< size_t > tail;
+    size_t producerHead;
+    char producerPad[ cacheLine ];
+
+    tbb::atomic< bool > closed, producerWaiting, consumerWaiting;
+    pthread_mutex_t mutex;
+    pthread_cond_t notFull, notEmpty;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXRING_H_
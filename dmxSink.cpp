@@ -0,0 +1,88 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxSink.h"
+
+dmxSinkSet::~dmxSinkSet() {
+  close();
+}
+
+void dmxSinkSet::open( const std::vector< std::string > & fileNames, dmxWriter::compressionType compression ) {
+  close();
+  for ( size_t s = 0; s < fileNames.size(); ++s ) {
+    sinks.push_back( new sink() );
+    sinks.back()->name = fileNames[ s ];
+    sinks.back()->writer = new dmxWriter( fileNames[ s ], compression );
+    sinks.back()->records = 0;
+  }
+}
+
+void dmxSinkSet::added( size_t s ) {
+  ++sinks[ s ]->records;
+  stage & st = local()[ s ];
+  if ( st.bytes.size() >= stagingBytes ) {
+    flush( s, st );
+  }
+}
+
+void dmxSinkSet::flush( size_t s, stage & st ) {
+  if ( st.bytes.empty() ) {
+    return;
+  }
+  dmxWriter * w = sinks[ s ]->writer;
+  // compressed pieces are independent, so only the write itself is locked
+  if ( w->compressed() ) {
+    w->compress( st.bytes, st.packed );
+  }
+  {
+    tbb::mutex::scoped_lock lock( sinks[ s ]->lock );
+    w->write( w->compressed() ? st.packed : st.bytes );
+  }
+  st.bytes.clear();
+}
+
+void dmxSinkSet::close() {
+  for ( tbb::enumerable_thread_specific< std::vector< stage > >::iterator it = staging.begin(); it != staging.end(); ++it ) {
+    for ( size_t s = 0; s < it->size(); ++s ) {
+      flush( s, (*it)[ s ] );
+    }
+  }
+  staging.clear();
+  for ( size_t s = 0; s < sinks.size(); ++s ) {
+    sinks[ s ]->writer->close();
+    delete sinks[ s ]->writer;
+    delete sinks[ s ];
+  }
+  sinks.clear();
+}
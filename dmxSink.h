@@ -0,0 +1,111 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXSINK_H_
+#define SANDBOX_JVD_APPS_DMX_DMXSINK_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <tbb/atomic.h>
+#include <tbb/mutex.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#include "dmxWriter.h"
+
+/*
+ * A set of output files that records are streamed to from many threads at
+ * once.  Each thread formats into its own staging buffer per file; a buffer
+ * that fills up is compressed (if the files are) on that thread and appended
+ * to its file under the file's lock.  Memory is bounded by threads x files x
+ * stagingBytes however much is written.  Records of one thread stay in
+ * order, but records of different threads interleave in no fixed order.
+ */
+class dmxSinkSet {
+
+  public:
+
+    static const size_t stagingBytes = 1 << 20;
+
+    dmxSinkSet() { }
+    ~dmxSinkSet();
+
+    void open( const std::vector< std::string > & fileNames, dmxWriter::compressionType compression );
+
+    size_t size() { return sinks.size(); }
+    const std::string & fileName( size_t s ) { return sinks[ s ]->name; }
+    unsigned long records( size_t s ) { return sinks[ s ]->records; }
+
+    // the calling thread's staging buffer for sink s; append a record to it,
+    // then call added
+    std::string & buffer( size_t s ) { return local()[ s ].bytes; }
+    void added( size_t s );
+
+    // writes out what every thread has staged and closes the files; only
+    // once no thread is adding records
+    void close();
+
+  private:
+
+    dmxSinkSet( const dmxSinkSet & );
+    dmxSinkSet & operator=( const dmxSinkSet & );
+
+    struct sink {
+      std::string name;
+      dmxWriter * writer;
+      tbb::mutex lock;
+      tbb::atomic< unsigned long > records;
+    };
+
+    struct stage {
+      std::string bytes, packed;
+    };
+
+    // the calling thread's stages, one per sink
+    std::vector< stage > & local() {
+      std::vector< stage > & v = staging.local();
+      if ( v.size() != sinks.size() ) {
+        v.resize( sinks.size() );
+      }
+      return v;
+    }
+    void flush( size_t s, stage & st );
+
+    std::vector< sink * > sinks;
+    tbb::enumerable_thread_specific< std::vector< stage > > staging;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXSINK_H_
@@ -0,0 +1,138 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxSketch.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+  const uint64_t emptyBin = ~(uint64_t) 0;
+
+  inline uint64_t mix( uint64_t h ) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  // k-mers of the reverse mate hash apart from the same k-mers forward
+  struct sketchBins {
+    uint64_t * bins;
+    uint64_t salt;
+    unsigned shift;
+    void operator()( uint64_t code ) {
+      uint64_t h = mix( code ^ salt );
+      uint64_t & bin = bins[ h >> shift ];
+      if ( h < bin ) {
+        bin = h;
+      }
+    }
+  };
+
+  size_t findRoot( std::vector< size_t > & parent, size_t i ) {
+    while ( parent[ i ] != i ) {
+      parent[ i ] = parent[ parent[ i ] ];
+      i = parent[ i ];
+    }
+    return i;
+  }
+}
+
+void dmxSketchClusterer::sketch( dmxRead * read, uint64_t * bins ) const {
+  std::fill( bins, bins + sketchSize, emptyBin );
+  sketchBins visit;
+  visit.bins = bins;
+  visit.shift = 64 - sketchBits;
+  visit.salt = 0;
+  read->fSeq.forEachKmer( kmerLength, visit );
+  visit.salt = 0x9E3779B97F4A7C15ULL;
+  read->rSeq.forEachKmer( kmerLength, visit );
+}
+
+void dmxSketchClusterer::cluster( const std::vector< dmxRead * > & reads, std::vector< int > & clusters ) const {
+  size_t n = reads.size();
+  const unsigned bands = sketchSize / bandRows;
+
+  // ( bucket, read ) for every band of every read that has k-mers in it
+  std::vector< std::pair< uint64_t, size_t > > buckets;
+  buckets.reserve( n * bands );
+  uint64_t bins[ sketchSize ];
+  for ( size_t i = 0; i < n; ++i ) {
+    sketch( reads[ i ], bins );
+    for ( unsigned b = 0; b < bands; ++b ) {
+      uint64_t h = mix( b + 1 );
+      bool empty = true;
+      for ( unsigned r = 0; r < bandRows; ++r ) {
+        uint64_t v = bins[ b * bandRows + r ];
+        empty = empty && v == emptyBin;
+        h = mix( h ^ v );
+      }
+      if ( !empty ) {
+        buckets.push_back( std::make_pair( h, i ) );
+      }
+    }
+  }
+  std::sort( buckets.begin(), buckets.end() );
+
+  // reads next to each other in a bucket are joined
+  std::vector< size_t > parent( n );
+  for ( size_t i = 0; i < n; ++i ) {
+    parent[ i ] = i;
+  }
+  for ( size_t j = 1; j < buckets.size(); ++j ) {
+    if ( buckets[ j ].first == buckets[ j - 1 ].first ) {
+      size_t a = findRoot( parent, buckets[ j ].second );
+      size_t b = findRoot( parent, buckets[ j - 1 ].second );
+      if ( a != b ) {
+        parent[ std::max( a, b ) ] = std::min( a, b );
+      }
+    }
+  }
+
+  // numbered in order of first reads
+  std::vector< int > label( n, 0 );
+  int next = 0;
+  clusters.resize( n );
+  for ( size_t i = 0; i < n; ++i ) {
+    size_t root = findRoot( parent, i );
+    if ( label[ root ] == 0 ) {
+      label[ root ] = ++next;
+    }
+    clusters[ i ] = label[ root ];
+  }
+}
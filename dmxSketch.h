@@ -0,0 +1,76 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXSKETCH_H_
+#define SANDBOX_JVD_APPS_DMX_DMXSKETCH_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "dmxRead.h"
+
+/*
+ * Clusters the reads of a group in near linear time.  Each read gets a
+ * MinHash sketch of the k-mers of both mates, by one permutation hashing:
+ * every k-mer is hashed once, into one of sketchSize bins that keeps the
+ * smallest hash.  Sketches are cut into bands of bandRows bins, reads whose
+ * sketches agree on a whole band share that band's bucket, and reads linked
+ * by shared buckets, directly or through others, form a cluster.  Two reads
+ * whose k-mer sets have Jaccard similarity J share a bucket with probability
+ * 1 - ( 1 - J^bandRows )^( sketchSize / bandRows ).
+ */
+class dmxSketchClusterer {
+
+  public:
+
+    static const unsigned defaultKmerLength = 12;
+    static const unsigned sketchBits = 5;
+    static const unsigned sketchSize = 1 << sketchBits;
+    static const unsigned bandRows = 4;
+
+    dmxSketchClusterer( unsigned _kmerLength = defaultKmerLength ) : kmerLength( _kmerLength ) { }
+
+    // clusters[ i ] is the cluster of reads[ i ], numbered from 1 in the
+    // order of their first reads; a read without k-mers is a cluster alone
+    void cluster( const std::vector< dmxRead * > & reads, std::vector< int > & clusters ) const;
+
+  private:
+
+    void sketch( dmxRead * read, uint64_t * bins ) const;
+
+    unsigned kmerLength;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXSKETCH_H_
@@ -0,0 +1,273 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxSpill.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+
+#include <tbb/parallel_sort.h>
+
+namespace {
+
+  const size_t runWriteBytes = 1 << 20;
+
+  FILE * openOrDie( const std::string & name ) {
+    FILE * file = fopen( name.c_str(), "wb" );
+    if ( file == NULL ) {
+      std::cerr << "Unable to open spill file " << name << std::endl;
+      std::exit( 1 );
+    }
+    return file;
+  }
+
+  void closeOrDie( FILE * file, const std::string & name ) {
+    if ( fclose( file ) != 0 ) {
+      std::cerr << "Error closing spill file " << name << std::endl;
+      std::exit( 1 );
+    }
+  }
+
+  void writeOrDie( FILE * file, const std::string & bytes, const std::string & name ) {
+    if ( !bytes.empty() && fwrite( bytes.data(), 1, bytes.size(), file ) != bytes.size() ) {
+      std::cerr << "Error writing spill file " << name << std::endl;
+      std::exit( 1 );
+    }
+  }
+}
+
+// bufferBytes passes runBufferBytes and minRunBufferBytes to std::min and
+// std::max by reference
+const size_t dmxRunMerger::runBufferBytes;
+const size_t dmxRunMerger::minRunBufferBytes;
+
+dmxSpill::~dmxSpill() {
+  remove();
+}
+
+void dmxSpill::init( const std::string & _prefix ) {
+  prefix = _prefix;
+}
+
+void dmxSpill::writeRun( std::vector< dmxRead * > & reads ) {
+  if ( reads.empty() ) {
+    return;
+  }
+  tbb::parallel_sort( reads.begin(), reads.end(), dmxReadCompare() );
+
+  std::string name;
+  {
+    tbb::mutex::scoped_lock l( lock );
+    name = newName();
+    names.push_back( name );
+  }
+  FILE * file = openOrDie( name );
+  std::string bytes;
+  bytes.reserve( runWriteBytes );
+  for ( size_t i = 0; i < reads.size(); ++i ) {
+    reads[ i ]->appendRecord( bytes );
+    if ( bytes.size() >= runWriteBytes ) {
+      writeOrDie( file, bytes, name );
+      bytes.clear();
+    }
+  }
+  writeOrDie( file, bytes, name );
+  closeOrDie( file, name );
+  recordCount += reads.size();
+
+  // only counted once it is complete
+  tbb::mutex::scoped_lock l( lock );
+  ++runCount;
+}
+
+std::string dmxSpill::newName() {
+  std::ostringstream name;
+  name << prefix << "." << nextRun++;
+  return name.str();
+}
+
+void dmxSpill::limitRuns( size_t maxRuns, size_t bufferBytes ) {
+  maxRuns = std::max( maxRuns, (size_t) 2 );
+  while ( names.size() > maxRuns ) {
+    // one pass merges consecutive runs, so reads with equal keys stay in
+    // run order
+    std::vector< std::string > merged;
+    for ( size_t first = 0; first < names.size(); first += maxRuns ) {
+      size_t last = std::min( names.size(), first + maxRuns );
+      if ( last - first == 1 ) {
+        merged.push_back( names[ first ] );
+        continue;
+      }
+      std::vector< std::string > inputs( names.begin() + first, names.begin() + last );
+      std::string name = newName();
+      FILE * file = openOrDie( name );
+      {
+        dmxRunMerger merger( inputs, bufferBytes );
+        std::string bytes;
+        bytes.reserve( runWriteBytes );
+        while ( merger.nextRecord( bytes ) ) {
+          if ( bytes.size() >= runWriteBytes ) {
+            writeOrDie( file, bytes, name );
+            bytes.clear();
+          }
+        }
+        writeOrDie( file, bytes, name );
+      }
+      closeOrDie( file, name );
+      for ( size_t i = 0; i < inputs.size(); ++i ) {
+        std::remove( inputs[ i ].c_str() );
+      }
+      merged.push_back( name );
+    }
+    names.swap( merged );
+  }
+  runCount = names.size();
+}
+
+void dmxSpill::remove() {
+  for ( size_t i = 0; i < names.size(); ++i ) {
+    std::remove( names[ i ].c_str() );
+  }
+  names.clear();
+  runCount = 0;
+  recordCount = 0;
+}
+
+size_t dmxRunMerger::bufferBytes( size_t budget, size_t runs ) {
+  size_t share = runs > 0 ? budget / runs : budget;
+  return std::max( minRunBufferBytes, std::min( runBufferBytes, share ) );
+}
+
+dmxRunMerger::dmxRunMerger( const std::vector< std::string > & fileNames, size_t _bufferBytes ) {
+  for ( size_t i = 0; i < fileNames.size(); ++i ) {
+    run * r = new run();
+    r->name = fileNames[ i ];
+    r->file = fopen( r->name.c_str(), "rb" );
+    if ( r->file == NULL ) {
+      std::cerr << "Unable to open spill file " << r->name << std::endl;
+      std::exit( 1 );
+    }
+    r->buffer.resize( _bufferBytes );
+    r->pos = 0;
+    r->end = 0;
+    r->index = i;
+    runs.push_back( r );
+    if ( advance( *r ) ) {
+      heap.push( r );
+    }
+  }
+}
+
+dmxRunMerger::~dmxRunMerger() {
+  for ( size_t i = 0; i < runs.size(); ++i ) {
+    fclose( runs[ i ]->file );
+    delete runs[ i ];
+  }
+}
+
+bool dmxRunMerger::fill( run & r, size_t bytes ) {
+  if ( r.end - r.pos >= bytes ) {
+    return true;
+  }
+  // move what is left to the front and read after it
+  size_t left = r.end - r.pos;
+  memmove( &r.buffer[ 0 ], &r.buffer[ r.pos ], left );
+  r.pos = 0;
+  r.end = left;
+  if ( r.buffer.size() < bytes ) {
+    r.buffer.resize( bytes );
+  }
+  r.end += fread( &r.buffer[ r.end ], 1, r.buffer.size() - r.end, r.file );
+  return r.end >= bytes;
+}
+
+bool dmxRunMerger::advance( run & r ) {
+  if ( !fill( r, sizeof( uint32_t ) ) ) {
+    if ( r.end != r.pos ) {
+      std::cerr << "Truncated spill file " << r.name << std::endl;
+      std::exit( 1 );
+    }
+    return false;
+  }
+  if ( !fill( r, dmxRead::recordBytes( &r.buffer[ r.pos ] ) ) ) {
+    std::cerr << "Truncated spill file " << r.name << std::endl;
+    std::exit( 1 );
+  }
+  dmxRead::recordKey( &r.buffer[ r.pos ], r.key );
+  return true;
+}
+
+bool dmxRunMerger::peek( dmxReadKey & key ) {
+  if ( heap.empty() ) {
+    return false;
+  }
+  key = heap.top()->key;
+  return true;
+}
+
+dmxRunMerger::run * dmxRunMerger::pop() {
+  run * r = heap.top();
+  heap.pop();
+  return r;
+}
+
+dmxRead * dmxRunMerger::next( dmxArena & arena ) {
+  if ( heap.empty() ) {
+    return NULL;
+  }
+  run * r = pop();
+  dmxRead * read = dmxRead::fromRecord( arena, &r->buffer[ r->pos ] );
+  r->pos += dmxRead::recordBytes( &r->buffer[ r->pos ] );
+  if ( advance( *r ) ) {
+    heap.push( r );
+  }
+  return read;
+}
+
+bool dmxRunMerger::nextRecord( std::string & bytes ) {
+  if ( heap.empty() ) {
+    return false;
+  }
+  run * r = pop();
+  size_t recordBytes = dmxRead::recordBytes( &r->buffer[ r->pos ] );
+  bytes.append( &r->buffer[ r->pos ], recordBytes );
+  r->pos += recordBytes;
+  if ( advance( *r ) ) {
+    heap.push( r );
+  }
+  return true;
+}
@@ -0,0 +1,159 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXSPILL_H_
+#define SANDBOX_JVD_APPS_DMX_DMXSPILL_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <queue>
+
+#include <tbb/atomic.h>
+#include <tbb/mutex.h>
+
+#include "dmxArena.h"
+#include "dmxRead.h"
+
+/*
+ * Reads of one category spilled to scratch files as sorted runs of dmxRead
+ * records, so that more reads can be grouped than fit in memory.  Any thread
+ * may write a run; the runs are read back in key order by a dmxRunMerger and
+ * removed with the set.  The number of runs grows with the input, so before
+ * the final merge they are merged a bounded number at a time into longer
+ * runs, which keeps the open files and merge buffers bounded too.
+ */
+class dmxSpill {
+
+  public:
+
+    dmxSpill() : runCount( 0 ), nextRun( 0 ) { recordCount = 0; }
+    ~dmxSpill();
+
+    // runs are named prefix.0, prefix.1, ...
+    void init( const std::string & _prefix );
+
+    // sorts reads by key and writes them out as one run; the reads are left
+    // for the caller to free
+    void writeRun( std::vector< dmxRead * > & reads );
+
+    // merges runs maxRuns at a time, keeping their order, until no more
+    // than maxRuns are left, each read through bufferBytes; not safe while
+    // runs are still being written
+    void limitRuns( size_t maxRuns, size_t bufferBytes );
+
+    size_t runs() { return runCount; }
+    unsigned long records() { return recordCount; }
+    const std::vector< std::string > & fileNames() { return names; }
+
+    // deletes the run files
+    void remove();
+
+  private:
+
+    dmxSpill( const dmxSpill & );
+    dmxSpill & operator=( const dmxSpill & );
+
+    std::string newName();
+
+    std::string prefix;
+    tbb::mutex lock;
+    std::vector< std::string > names;
+    size_t runCount;
+    size_t nextRun;
+    tbb::atomic< unsigned long > recordCount;
+};
+
+/*
+ * k-way merge of sorted runs.  Each run is read through a buffer of its own,
+ * and the run with the smallest key next is kept at the top of a heap; reads
+ * with equal keys come out in run order.  Every run stays open for the life
+ * of the merger, so callers keep the fan-in to maxFanIn (see
+ * dmxSpill::limitRuns).
+ */
+class dmxRunMerger {
+
+  public:
+
+    static const size_t maxFanIn = 64;
+    static const size_t runBufferBytes = 1 << 20;
+    static const size_t minRunBufferBytes = 1 << 16;
+
+    // the buffer each of runs runs gets out of a budget of bytes
+    static size_t bufferBytes( size_t budget, size_t runs );
+
+    dmxRunMerger( const std::vector< std::string > & fileNames, size_t _bufferBytes = runBufferBytes );
+    ~dmxRunMerger();
+
+    // the key of the next read; false once every run is done
+    bool peek( dmxReadKey & key );
+    // the next read, rebuilt in arena; NULL once every run is done
+    dmxRead * next( dmxArena & arena );
+    // the next read's record, appended to bytes as it is; false once every
+    // run is done
+    bool nextRecord( std::string & bytes );
+
+  private:
+
+    dmxRunMerger( const dmxRunMerger & );
+    dmxRunMerger & operator=( const dmxRunMerger & );
+
+    struct run {
+      std::string name;
+      FILE * file;
+      std::vector< char > buffer;
+      size_t pos, end;
+      size_t index;
+      dmxReadKey key;
+    };
+
+    struct runAfter {
+      bool operator() ( const run * a, const run * b ) const {
+        if ( b->key < a->key ) return true;
+        if ( a->key < b->key ) return false;
+        return a->index > b->index;
+      }
+    };
+
+    // makes the next record of r whole in its buffer; false at its end
+    bool advance( run & r );
+    bool fill( run & r, size_t bytes );
+    run * pop();
+
+    std::vector< run * > runs;
+    std::priority_queue< run *, std::vector< run * >, runAfter > heap;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXSPILL_H_
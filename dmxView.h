@@ -0,0 +1,67 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXVIEW_H_
+#define SANDBOX_JVD_APPS_DMX_DMXVIEW_H_
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Characters owned by someone else: a line of an input block, or part of
+ * one.  Valid only as long as the block is; nothing is copied until str().
+ */
+struct dmxView {
+  const char * ptr;
+  size_t length;
+
+  dmxView() : ptr( NULL ), length( 0 ) { }
+  dmxView( const char * _ptr, size_t _length ) : ptr( _ptr ), length( _length ) { }
+  dmxView( const std::string & s ) : ptr( s.data() ), length( s.size() ) { }
+
+  const char * data() const { return ptr; }
+  size_t size() const { return length; }
+  bool empty() const { return length == 0; }
+  char operator[] ( size_t i ) const { return ptr[ i ]; }
+
+  // the characters from pos on (none if pos is past the end)
+  dmxView from( size_t pos ) const {
+    return pos < length ? dmxView( ptr + pos, length - pos ) : dmxView( ptr + length, 0 );
+  }
+
+  std::string str() const { return std::string( ptr, length ); }
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXVIEW_H_
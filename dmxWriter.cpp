@@ -0,0 +1,228 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#include "dmxWriter.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <zlib.h>
+#ifdef DMX_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+  // an empty BGZF block, which marks the end of the file
+  const unsigned char bgzfEof[ 28 ] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+  };
+
+  const size_t bgzfHeaderSize = 18;
+  const size_t bgzfFooterSize = 8;
+
+  inline void putLe16( unsigned char * p, unsigned v ) {
+    p[ 0 ] = v & 0xff;
+    p[ 1 ] = ( v >> 8 ) & 0xff;
+  }
+
+  inline void putLe32( unsigned char * p, unsigned long v ) {
+    putLe16( p, v & 0xffff );
+    putLe16( p + 2, ( v >> 16 ) & 0xffff );
+  }
+}
+
+void appendUnsigned( std::string & out, unsigned long v ) {
+  char digits[ 24 ];
+  char * p = digits + sizeof( digits );
+  do {
+    *--p = (char) ( '0' + v % 10 );
+    v /= 10;
+  } while ( v != 0 );
+  out.append( p, digits + sizeof( digits ) - p );
+}
+
+void appendInt( std::string & out, long v ) {
+  if ( v < 0 ) {
+    out += '-';
+    appendUnsigned( out, 0UL - (unsigned long) v );
+  }
+  else {
+    appendUnsigned( out, (unsigned long) v );
+  }
+}
+
+////////// dmxWriter //////////////
+
+// compressBgzf passes bgzfBlockInput to std::min by reference
+const size_t dmxWriter::bgzfBlockInput;
+
+dmxWriter::dmxWriter( const std::string & filename, compressionType _compression ) {
+  fileName = filename;
+  compression = _compression;
+  written = 0;
+  fd = open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if ( fd < 0 ) {
+    std::cerr << "Error writing " << fileName << ": unable to open (" << strerror( errno ) << ")" << std::endl;
+    std::exit( 1 );
+  }
+}
+
+dmxWriter::~dmxWriter() {
+  close();
+}
+
+void dmxWriter::write( const char * data, size_t length ) {
+  while ( length > 0 ) {
+    ssize_t n = ::write( fd, data, length );
+    if ( n < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      std::cerr << "Error writing " << fileName << ": " << strerror( errno ) << std::endl;
+      std::exit( 1 );
+    }
+    data += n;
+    length -= n;
+    written += n;
+  }
+}
+
+dmxWriter::compressionType dmxWriter::parseCompression( const std::string & name ) {
+  if ( name == "none" ) {
+    return NO_COMPRESSION;
+  }
+  if ( name == "gzip" ) {
+    return GZIP_COMPRESSION;
+  }
+  if ( name == "zstd" ) {
+#ifdef DMX_HAVE_ZSTD
+    return ZSTD_COMPRESSION;
+#else
+    std::cerr << "dmx was built without zstd; rebuild with DMX_ZSTD on or use gzip" << std::endl;
+    std::exit( 1 );
+#endif
+  }
+  std::cerr << "Unknown compression: " << name << " (expected none, gzip or zstd)" << std::endl;
+  std::exit( 1 );
+}
+
+const char * dmxWriter::suffix( compressionType c ) {
+  switch ( c ) {
+    case GZIP_COMPRESSION:
+      return ".gz";
+    case ZSTD_COMPRESSION:
+      return ".zst";
+    default:
+      return "";
+  }
+}
+
+void dmxWriter::compress( const std::string & in, std::string & out ) const {
+  if ( compression == ZSTD_COMPRESSION ) {
+    compressZstd( in, out );
+  }
+  else {
+    compressBgzf( in, out );
+  }
+}
+
+void dmxWriter::compressBgzf( const std::string & in, std::string & out ) const {
+  out.clear();
+  z_stream zs;
+  memset( &zs, 0, sizeof( zs ) );
+  // raw deflate; the BGZF header and footer are written here
+  if ( deflateInit2( &zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) {
+    std::cerr << "Error writing " << fileName << ": unable to start compression" << std::endl;
+    std::exit( 1 );
+  }
+  for ( size_t pos = 0; pos < in.size(); pos += bgzfBlockInput ) {
+    size_t length = std::min( bgzfBlockInput, in.size() - pos );
+    size_t at = out.size();
+    out.resize( at + bgzfHeaderSize + deflateBound( &zs, length ) + bgzfFooterSize );
+    unsigned char * block = (unsigned char *) &out[ at ];
+
+    deflateReset( &zs );
+    zs.next_in = (Bytef *) ( in.data() + pos );
+    zs.avail_in = length;
+    zs.next_out = block + bgzfHeaderSize;
+    zs.avail_out = out.size() - at - bgzfHeaderSize - bgzfFooterSize;
+    if ( deflate( &zs, Z_FINISH ) != Z_STREAM_END ) {
+      std::cerr << "Error writing " << fileName << ": compression failed" << std::endl;
+      std::exit( 1 );
+    }
+    size_t blockSize = bgzfHeaderSize + zs.total_out + bgzfFooterSize;
+
+    memcpy( block, bgzfEof, bgzfHeaderSize );
+    putLe16( block + 16, blockSize - 1 );
+    unsigned char * footer = block + bgzfHeaderSize + zs.total_out;
+    putLe32( footer, crc32( crc32( 0L, Z_NULL, 0 ), (const Bytef *) in.data() + pos, length ) );
+    putLe32( footer + 4, length );
+    out.resize( at + blockSize );
+  }
+  deflateEnd( &zs );
+}
+
+void dmxWriter::compressZstd( const std::string & in, std::string & out ) const {
+#ifdef DMX_HAVE_ZSTD
+  out.resize( ZSTD_compressBound( in.size() ) );
+  size_t n = ZSTD_compress( &out[ 0 ], out.size(), in.data(), in.size(), 3 );
+  if ( ZSTD_isError( n ) ) {
+    std::cerr << "Error writing " << fileName << ": " << ZSTD_getErrorName( n ) << std::endl;
+    std::exit( 1 );
+  }
+  out.resize( n );
+#else
+  out = in;
+#endif
+}
+
+void dmxWriter::close() {
+  if ( fd >= 0 ) {
+    if ( compression == GZIP_COMPRESSION ) {
+      write( (const char *) bgzfEof, sizeof( bgzfEof ) );
+    }
+    if ( ::close( fd ) != 0 ) {
+      std::cerr << "Error writing " << fileName << ": " << strerror( errno ) << std::endl;
+      std::exit( 1 );
+    }
+    fd = -1;
+  }
+}
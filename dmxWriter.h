@@ -0,0 +1,103 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_DMXWRITER_H_
+#define SANDBOX_JVD_APPS_DMX_DMXWRITER_H_
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Appends the decimal digits of v to out, without going through a stream.
+ */
+void appendUnsigned( std::string & out, unsigned long v );
+void appendInt( std::string & out, long v );
+
+/*
+ * Output file written with large unbuffered write() calls.  Callers format
+ * records into their own (reusable) buffers and hand over whole buffers, in
+ * the order they should appear in the file.
+ *
+ * Compressed output is made of independent pieces, so buffers can be
+ * compressed by compress() on any thread before they are handed over: gzip
+ * output is BGZF (blocks of at most 64 KB, readable by any gzip reader, and
+ * ended by the BGZF end-of-file block on close), zstd output is one frame per
+ * buffer.  zstd is only there when built with DMX_HAVE_ZSTD.
+ */
+class dmxWriter {
+
+  public:
+
+    enum compressionType { NO_COMPRESSION, GZIP_COMPRESSION, ZSTD_COMPRESSION };
+
+    // bytes of formatted records to collect before handing them over
+    static const size_t batchBytes = 1 << 22;
+    // uncompressed bytes per BGZF block, leaving room for incompressible data
+    static const size_t bgzfBlockInput = 0xff00;
+
+    dmxWriter( const std::string & filename, compressionType _compression = NO_COMPRESSION );
+    ~dmxWriter();
+
+    // none, gzip or zstd; exits on anything else, or zstd when not built in
+    static compressionType parseCompression( const std::string & name );
+    // file name extension for the compression
+    static const char * suffix( compressionType c );
+
+    bool compressed() const { return compression != NO_COMPRESSION; }
+    // replaces out with in, compressed; safe to call concurrently
+    void compress( const std::string & in, std::string & out ) const;
+
+    void write( const char * data, size_t length );
+    void write( const std::string & s ) { write( s.data(), s.size() ); }
+
+    void close();
+
+    size_t bytesWritten() { return written; }
+
+  private:
+
+    dmxWriter( const dmxWriter & );
+    dmxWriter & operator=( const dmxWriter & );
+
+    void compressBgzf( const std::string & in, std::string & out ) const;
+    void compressZstd( const std::string & in, std::string & out ) const;
+
+    std::string fileName;
+    compressionType compression;
+    int fd;
+    size_t written;
+};
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_DMXWRITER_H_
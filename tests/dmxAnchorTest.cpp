@@ -0,0 +1,209 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+// Regression checks for primer re-anchoring: reads with an indel upstream of
+// the barcode must stop falling through to NO_MATCH once they are anchored,
+// and no shift the anchor reports may move a layout to before the read.
+
+#include <string>
+#include <vector>
+
+#include "dmxTest.h"
+#include "../dmxBarcode.h"
+#include "../dmxMatcher.h"
+#include "../dmxMyers.h"
+
+namespace {
+
+  const char * primer = "ACGTTGCAACGTGGCATTACG";
+  const char * barcodeStrings[] = { "AACCGG", "TTGGCC", "CAGTCA", "GTACTG" };
+  const size_t barcodeCount = 4;
+
+  struct fixtureRead {
+    std::string seq;
+    int index;
+    int shift;
+  };
+
+  // primer, random tag, barcode, random primer and sequence; every fifth
+  // read has one base inserted into, or two deleted from, the start of the
+  // primer, ahead of the anchored tail
+  std::vector< fixtureRead > makeShiftedReads( size_t n ) {
+    dmxTestRandom random( 3 );
+    std::vector< fixtureRead > reads( n );
+    for ( size_t i = 0; i < n; ++i ) {
+      fixtureRead & r = reads[ i ];
+      r.index = random.below( barcodeCount );
+      r.shift = 0;
+      std::string p = primer;
+      if ( i % 5 == 0 ) {
+        size_t at = random.below( 4 );
+        if ( random.below( 2 ) == 0 ) {
+          p.insert( at, random.bases( 1 ) );
+          r.shift = 1;
+        }
+        else {
+          p.erase( at, 2 );
+          r.shift = -2;
+        }
+      }
+      r.seq = p + random.bases( 6 ) + barcodeStrings[ r.index ] + random.bases( 6 ) + random.bases( 80 );
+    }
+    return reads;
+  }
+
+  void loadBarcodes( const std::string & layout, const std::string & prefix, std::vector< barcode > & barcodes, std::vector< barcode * > & barcodeList ) {
+    barcodes.resize( barcodeCount );
+    for ( size_t b = 0; b < barcodeCount; ++b ) {
+      barcodes[ b ].loadBarcode( layout, prefix + barcodeStrings[ b ] + "NNNNNN" );
+      barcodeList.push_back( &barcodes[ b ] );
+    }
+  }
+
+  // what digest does for one mate: match at the layout position, then
+  // anchor the misses and match those whose primer moved again
+  std::vector< dmxMatch > matchMates( const std::vector< dmxView > & seqs, const dmxLayoutMatcher * table,
+      const dmxMyersMatcher * myers, const dmxPrimerAnchor * anchor ) {
+    size_t n = seqs.size();
+    std::vector< dmxMatch > matches( n );
+    if ( myers != NULL ) {
+      myers->match( &seqs[ 0 ], n, &matches[ 0 ] );
+    }
+    else {
+      for ( size_t i = 0; i < n; ++i ) {
+        matches[ i ] = table->match( seqs[ i ] );
+      }
+    }
+    if ( anchor == NULL ) {
+      return matches;
+    }
+    std::vector< int > shifts( n );
+    anchor->locate( &seqs[ 0 ], n, &shifts[ 0 ] );
+    for ( size_t i = 0; i < n; ++i ) {
+      if ( matches[ i ].index >= 0 || shifts[ i ] == 0 ) {
+        continue;
+      }
+      dmxMatch m = myers != NULL ? myers->match( seqs[ i ], shifts[ i ] ) : table->match( seqs[ i ], shifts[ i ] );
+      if ( m.index >= 0 ) {
+        matches[ i ] = m;
+      }
+    }
+    return matches;
+  }
+
+  size_t countMissed( const std::vector< dmxMatch > & matches ) {
+    size_t missed = 0;
+    for ( size_t i = 0; i < matches.size(); ++i ) {
+      missed += matches[ i ].index < 0;
+    }
+    return missed;
+  }
+
+  void checkNoMatchReduction( bool useMyers ) {
+    std::vector< barcode > barcodes;
+    std::vector< barcode * > barcodeList;
+    loadBarcodes( "P21R6B6N6", std::string( primer ) + "NNNNNN", barcodes, barcodeList );
+    dmxLayoutMatcher table;
+    table.build( barcodeList, 1 );
+    // at distance 0 the Myers window is the barcode itself, so an indel is
+    // only found by anchoring, as with the table
+    dmxMyersMatcher myers;
+    myers.build( barcodeList, 0 );
+    dmxPrimerAnchor anchor;
+    anchor.build( barcodeList, 2 );
+    DMX_CHECK( anchor.enabled() );
+
+    std::vector< fixtureRead > reads = makeShiftedReads( 2000 );
+    std::vector< dmxView > seqs;
+    for ( size_t i = 0; i < reads.size(); ++i ) {
+      seqs.push_back( reads[ i ].seq );
+    }
+    std::vector< dmxMatch > fixed = matchMates( seqs, &table, useMyers ? &myers : NULL, NULL );
+    std::vector< dmxMatch > anchored = matchMates( seqs, &table, useMyers ? &myers : NULL, &anchor );
+
+    // every shifted read misses at the layout position
+    size_t before = countMissed( fixed );
+    size_t after = countMissed( anchored );
+    DMX_CHECK( before >= reads.size() / 6 );
+    DMX_CHECK( after * 100 <= reads.size() );
+
+    // anchored reads land on their own barcode, moved by their own shift
+    for ( size_t i = 0; i < reads.size(); ++i ) {
+      if ( anchored[ i ].index < 0 ) {
+        continue;
+      }
+      DMX_CHECK( anchored[ i ].index == reads[ i ].index );
+      if ( fixed[ i ].index < 0 ) {
+        DMX_CHECK( anchored[ i ].shift == reads[ i ].shift );
+      }
+    }
+  }
+
+  // a layout whose random tag starts the read: a primer found short of its
+  // position must not be used, since it would move the tag before the read
+  void checkShiftStaysInRead() {
+    std::vector< barcode > barcodes;
+    std::vector< barcode * > barcodeList;
+    std::string shortPrimer = std::string( primer ).substr( 9 );
+    loadBarcodes( "R4P12B6N6", "NNNN" + shortPrimer, barcodes, barcodeList );
+    dmxPrimerAnchor anchor;
+    anchor.build( barcodeList, 2 );
+    DMX_CHECK( anchor.enabled() );
+
+    dmxTestRandom random( 9 );
+    std::vector< std::string > seqs;
+    std::vector< int > shift;
+    for ( int i = 0; i < 300; ++i ) {
+      // a random tag one or two bases short, whole, or one base long
+      int s = (int) random.below( 4 ) - 2;
+      seqs.push_back( random.bases( 4 + s ) + shortPrimer + barcodeStrings[ i % barcodeCount ] + random.bases( 60 ) );
+      shift.push_back( s );
+    }
+    std::vector< dmxView > views( seqs.begin(), seqs.end() );
+    std::vector< int > shifts( views.size() );
+    anchor.locate( &views[ 0 ], views.size(), &shifts[ 0 ] );
+    for ( size_t i = 0; i < views.size(); ++i ) {
+      DMX_CHECK( (long) barcodes[ 0 ].randTagStart + shifts[ i ] >= 0 );
+      DMX_CHECK( shifts[ i ] == ( shift[ i ] > 0 ? shift[ i ] : 0 ) );
+    }
+  }
+}
+
+int main() {
+  checkNoMatchReduction( false );
+  checkNoMatchReduction( true );
+  checkShiftStaysInRead();
+
+  return dmxTestResult( "dmxAnchorTest" );
+}
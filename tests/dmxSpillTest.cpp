@@ -0,0 +1,155 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+// Round trip of the spill path: reads written out as sorted runs and merged
+// back, directly or through intermediate merge passes, must come out as the
+// same records, in the same order, as the reads sorted in memory with equal
+// keys kept in run order.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "dmxTest.h"
+#include "../dmxArena.h"
+#include "../dmxRead.h"
+#include "../dmxSpill.h"
+
+namespace {
+
+  const size_t runCount = 9;
+  const size_t readsPerRun = 700;
+
+  // reads drawn from few enough tags that many keys repeat, within a run
+  // and across runs; a few mates hold an N, and some mates are empty
+  void makeRuns( dmxArena & arena, bool compact, std::vector< std::vector< dmxRead * > > & runs ) {
+    dmxTestRandom random( 5 );
+    std::vector< std::string > tags;
+    for ( int t = 0; t < 300; ++t ) {
+      tags.push_back( random.bases( 12 ) );
+    }
+    unsigned id = 0;
+    runs.resize( runCount );
+    for ( size_t r = 0; r < runCount; ++r ) {
+      for ( size_t i = 0; i < readsPerRun; ++i ) {
+        dmxReadKey key;
+        std::string fTag = tags[ random.below( tags.size() ) ];
+        std::string rTag = tags[ random.below( tags.size() ) ];
+        key.appendFwd( fTag, 0, fTag.size() );
+        key.appendRev( rTag, 0, rTag.size() );
+        dmxRead * read = dmxRead::create( arena, BOTH, key, id++ );
+        std::string fSeq = random.bases( random.below( 8 ) == 0 ? 0 : 50 + random.below( 100 ) );
+        std::string rSeq = random.bases( 50 + random.below( 100 ) );
+        if ( !rSeq.empty() && random.below( 5 ) == 0 ) {
+          rSeq[ random.below( rSeq.size() ) ] = 'N';
+        }
+        read->fwd( random.below( 4 ), fSeq, random.qualities( fSeq.size() ), 0, arena, compact );
+        read->rev( random.below( 4 ), rSeq, random.qualities( rSeq.size() ), 0, arena, compact );
+        read->setGroupSize( 1 + random.below( 50 ) );
+        read->setClusterSize( 1 + random.below( 50 ) );
+        runs[ r ].push_back( read );
+      }
+    }
+  }
+
+  struct keyLess {
+    bool operator() ( dmxRead * x, dmxRead * y ) const { return x->key < y->key; }
+  };
+
+  std::string format( const std::vector< dmxRead * > & reads ) {
+    std::string out;
+    for ( size_t i = 0; i < reads.size(); ++i ) {
+      reads[ i ]->formatFastq( i, out );
+    }
+    return out;
+  }
+
+  void checkSpill( bool compact, size_t maxRuns, size_t bufferBytes ) {
+    dmxArena arena;
+    std::vector< std::vector< dmxRead * > > runs;
+    makeRuns( arena, compact, runs );
+
+    dmxSpill spill;
+    spill.init( dmxTestScratch( "spill" ) );
+    std::vector< dmxRead * > inMemory;
+    for ( size_t r = 0; r < runs.size(); ++r ) {
+      // writeRun leaves the run sorted as it was written
+      spill.writeRun( runs[ r ] );
+      inMemory.insert( inMemory.end(), runs[ r ].begin(), runs[ r ].end() );
+    }
+    std::stable_sort( inMemory.begin(), inMemory.end(), keyLess() );
+    DMX_CHECK( spill.runs() == runCount );
+    DMX_CHECK( spill.records() == runCount * readsPerRun );
+
+    spill.limitRuns( maxRuns, bufferBytes );
+    DMX_CHECK( spill.runs() <= std::max( maxRuns, (size_t) 2 ) );
+    DMX_CHECK( spill.records() == runCount * readsPerRun );
+    DMX_CHECK( spill.fileNames().size() == spill.runs() );
+
+    std::vector< dmxRead * > merged;
+    dmxArena mergeArena;
+    {
+      dmxRunMerger merger( spill.fileNames(), bufferBytes );
+      dmxReadKey key;
+      while ( merger.peek( key ) ) {
+        dmxRead * read = merger.next( mergeArena );
+        DMX_CHECK( read->key == key );
+        merged.push_back( read );
+      }
+      DMX_CHECK( merger.next( mergeArena ) == NULL );
+    }
+    DMX_CHECK( merged.size() == inMemory.size() );
+    DMX_CHECK_BYTES( format( inMemory ), format( merged ) );
+
+    std::vector< std::string > names = spill.fileNames();
+    spill.remove();
+    for ( size_t i = 0; i < names.size(); ++i ) {
+      DMX_CHECK( access( names[ i ].c_str(), F_OK ) != 0 );
+    }
+  }
+}
+
+int main() {
+  // one merge of every run
+  checkSpill( false, dmxRunMerger::maxFanIn, dmxRunMerger::runBufferBytes );
+  // intermediate passes two runs at a time, through buffers smaller than a
+  // record
+  checkSpill( false, 2, 16 );
+  checkSpill( false, 4, dmxRunMerger::bufferBytes( 1 << 20, 4 ) );
+  checkSpill( true, 3, 100 );
+
+  return dmxTestResult( "dmxSpillTest" );
+}
@@ -0,0 +1,142 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+// Round trip of the block splitter: a FASTQ fixture cut into blocks of many
+// sizes, so records straddle block ends and go through seam blocks, must
+// give back exactly the records of the whole fixture parsed as one block.
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "dmxTest.h"
+#include "../dmxFastq.h"
+
+namespace {
+
+  // records whose quality lines sometimes start with '@' and are followed by
+  // a line starting with '+' or '@', to exercise range resynchronization
+  std::string makeFixture( size_t records, bool crlf ) {
+    dmxTestRandom random( 7 );
+    const char * eol = crlf ? "\r\n" : "\n";
+    std::string s;
+    for ( size_t i = 0; i < records; ++i ) {
+      size_t length = 40 + random.below( 120 );
+      std::string qual = random.qualities( length );
+      if ( random.below( 4 ) == 0 ) {
+        qual[ 0 ] = '@';
+      }
+      if ( random.below( 8 ) == 0 ) {
+        qual[ 0 ] = '+';
+      }
+      std::ostringstream header;
+      header << "@read" << i << " 1:N:0:" << random.below( 1000 );
+      s += header.str() + eol;
+      s += random.bases( length ) + eol;
+      s += random.below( 2 ) ? "+" : "+" + header.str().substr( 1 );
+      s += eol;
+      s += qual + eol;
+    }
+    return s;
+  }
+
+  // the records as the reader sees them, one line each
+  void appendRecords( const std::deque< fastqRecord > & records, std::string & out ) {
+    for ( size_t i = 0; i < records.size(); ++i ) {
+      out.append( records[ i ].id.data(), records[ i ].id.size() );
+      out += '\t';
+      out.append( records[ i ].seq.data(), records[ i ].seq.size() );
+      out += '\t';
+      out.append( records[ i ].qual.data(), records[ i ].qual.size() );
+      out += '\n';
+    }
+  }
+
+  // parses data handed over blockSize bytes at a time, each block a
+  // dmxBlock of its own that the splitter frees once its records are taken
+  std::string split( const std::string & data, size_t blockSize, size_t trimSize, size_t numRanges ) {
+    dmxFastqSplitter splitter( "fixture", trimSize, numRanges );
+    std::string out;
+    unsigned long long consumed = 0;
+    for ( size_t pos = 0; pos < data.size() || pos == 0; pos += blockSize ) {
+      size_t length = std::min( blockSize, data.size() - pos );
+      dmxBlock * block = new dmxBlock();
+      block->refs = 1;
+      block->data.assign( data.begin() + pos, data.begin() + pos + length );
+      std::deque< fastqRecord > records;
+      bool atEnd = pos + length >= data.size();
+      splitter.parse( block, length > 0 ? &block->data[ 0 ] : NULL, length, atEnd, records );
+      appendRecords( records, out );
+      consumed += records.size();
+      splitter.release( consumed );
+      if ( atEnd ) {
+        break;
+      }
+    }
+    return out;
+  }
+
+  void checkFixture( const std::string & data, size_t trimSize ) {
+    std::string expected = split( data, data.size(), trimSize, 1 );
+    DMX_CHECK( !expected.empty() );
+
+    // a whole block cut into parallel ranges, then blocks small enough that
+    // most records are cut, down to a few bytes at a time
+    size_t sizes[] = { data.size(), 3 * dmxFastqSplitter::minRangeSize + 13, 65536, 4099, 97, 7 };
+    for ( size_t i = 0; i < sizeof( sizes ) / sizeof( sizes[ 0 ] ); ++i ) {
+      std::string actual = split( data, sizes[ i ], trimSize, 4 );
+      DMX_CHECK_BYTES( expected, actual );
+    }
+  }
+}
+
+int main() {
+  // enough for a block to be split into several ranges
+  std::string lf = makeFixture( 12000, false );
+  DMX_CHECK( lf.size() > 4 * dmxFastqSplitter::minRangeSize );
+  checkFixture( lf, 0 );
+  checkFixture( lf, 5 );
+
+  // CRLF lines, and a final line without its line end
+  std::string crlf = makeFixture( 500, true );
+  checkFixture( crlf, 0 );
+  checkFixture( crlf.substr( 0, crlf.size() - 2 ), 0 );
+
+  // the parsed fields must be the fixture's own, not just agree with each other
+  std::string one = "@r1\nACGTN\n+\nIIIII\n@r2\nGG\n+r2\n#@\n";
+  DMX_CHECK_BYTES( std::string( "@r1\tACGTN\tIIIII\n@r2\tGG\t#@\n" ), split( one, 5, 0, 1 ) );
+  DMX_CHECK_BYTES( std::string( "@r1\tGTN\tIII\n@r2\t\t\n" ), split( one, 3, 2, 1 ) );
+
+  return dmxTestResult( "dmxSplitterTest" );
+}
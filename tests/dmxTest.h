@@ -0,0 +1,140 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+#ifndef SANDBOX_JVD_APPS_DMX_TESTS_DMXTEST_H_
+#define SANDBOX_JVD_APPS_DMX_TESTS_DMXTEST_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+/*
+ * What the tests share: a failure count with a check macro, a repeatable
+ * generator for fixtures, and scratch file names.  Each test is its own
+ * program and exits non-zero if any check failed.
+ */
+
+static int dmxTestFailures = 0;
+
+#define DMX_CHECK( cond ) \
+  do { \
+    if ( !( cond ) ) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+      ++dmxTestFailures; \
+    } \
+  } while ( 0 )
+
+// the first byte at which a and b differ, or -1 if they are equal
+inline long dmxTestFirstDifference( const std::string & a, const std::string & b ) {
+  size_t n = a.size() < b.size() ? a.size() : b.size();
+  for ( size_t i = 0; i < n; ++i ) {
+    if ( a[ i ] != b[ i ] ) {
+      return (long) i;
+    }
+  }
+  return a.size() == b.size() ? -1 : (long) n;
+}
+
+#define DMX_CHECK_BYTES( expected, actual ) \
+  do { \
+    long at = dmxTestFirstDifference( expected, actual ); \
+    if ( at >= 0 ) { \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " differs from " #expected " at byte " << at \
+        << " (" << ( actual ).size() << " bytes, expected " << ( expected ).size() << ")" << std::endl; \
+      ++dmxTestFailures; \
+    } \
+  } while ( 0 )
+
+inline int dmxTestResult( const char * name ) {
+  if ( dmxTestFailures > 0 ) {
+    std::cerr << name << ": " << dmxTestFailures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << name << ": passed" << std::endl;
+  return 0;
+}
+
+/*
+ * Linear congruential generator, so fixtures are the same on every run and
+ * every platform.
+ */
+class dmxTestRandom {
+
+  public:
+
+    dmxTestRandom( unsigned long seed = 1 ) : state( seed ) { }
+
+    unsigned next() {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      return (unsigned) ( state >> 33 );
+    }
+
+    unsigned below( unsigned n ) { return next() % n; }
+
+    std::string bases( size_t n ) {
+      static const char acgt[] = "ACGT";
+      std::string s( n, 'A' );
+      for ( size_t i = 0; i < n; ++i ) {
+        s[ i ] = acgt[ below( 4 ) ];
+      }
+      return s;
+    }
+
+    std::string qualities( size_t n ) {
+      std::string s( n, 'I' );
+      for ( size_t i = 0; i < n; ++i ) {
+        s[ i ] = (char) ( 33 + 2 + below( 40 ) );
+      }
+      return s;
+    }
+
+  private:
+
+    unsigned long long state;
+};
+
+// a scratch file name unique to this process
+inline std::string dmxTestScratch( const char * name ) {
+  std::ostringstream s;
+  const char * dir = std::getenv( "TMPDIR" );
+  s << ( dir != NULL ? dir : "/tmp" ) << "/dmx_test_" << getpid() << "_" << name;
+  return s.str();
+}
+
+
+#endif  // #ifndef SANDBOX_JVD_APPS_DMX_TESTS_DMXTEST_H_
@@ -0,0 +1,178 @@
+// ==========================================================================
+//                                    dmx
+// ==========================================================================
+// Copyright (c) 2012, Jay DePasse, University of Pittsburgh
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Jay DePasse <jvd10@pitt.edu>
+// ==========================================================================
+
+// Round trip of the output writer: buffers written plain, as BGZF and (when
+// built in) as zstd frames must read back as exactly the bytes that were
+// handed over.  The BGZF file is read both by zlib's own gzip reader and by
+// dmxInflater, which must see it as BGZF and inflate it in parallel batches.
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+#ifdef DMX_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "dmxTest.h"
+#include "../dmxInflate.h"
+#include "../dmxWriter.h"
+
+namespace {
+
+  // FASTQ-like text, then incompressible bytes, in buffers of sizes around
+  // the BGZF block input, including an empty one
+  std::vector< std::string > makeBuffers() {
+    dmxTestRandom random( 11 );
+    std::vector< std::string > buffers;
+    size_t sizes[] = { 1, dmxWriter::bgzfBlockInput, dmxWriter::bgzfBlockInput + 1, 0, 3 * dmxWriter::bgzfBlockInput - 5, 1000 };
+    for ( size_t i = 0; i < sizeof( sizes ) / sizeof( sizes[ 0 ] ); ++i ) {
+      std::string text;
+      while ( text.size() < sizes[ i ] ) {
+        text += "@read ";
+        appendUnsigned( text, random.below( 1000000 ) );
+        text += '\n' + random.bases( 100 ) + "\n+\n" + random.qualities( 100 ) + '\n';
+      }
+      text.resize( sizes[ i ] );
+      buffers.push_back( text );
+    }
+    std::string noise( 2 * dmxWriter::bgzfBlockInput + 17, '\0' );
+    for ( size_t i = 0; i < noise.size(); ++i ) {
+      noise[ i ] = (char) random.below( 256 );
+    }
+    buffers.push_back( noise );
+    return buffers;
+  }
+
+  std::string writeFile( const std::string & name, dmxWriter::compressionType compression, const std::vector< std::string > & buffers ) {
+    dmxWriter writer( name, compression );
+    std::string compressed;
+    for ( size_t i = 0; i < buffers.size(); ++i ) {
+      if ( writer.compressed() ) {
+        writer.compress( buffers[ i ], compressed );
+        writer.write( compressed );
+      }
+      else {
+        writer.write( buffers[ i ] );
+      }
+    }
+    writer.close();
+    return name;
+  }
+
+  std::string readFile( const std::string & name ) {
+    std::ifstream in( name.c_str(), std::ios::binary );
+    return std::string( ( std::istreambuf_iterator< char >( in ) ), std::istreambuf_iterator< char >() );
+  }
+
+  std::string readGzip( const std::string & name ) {
+    std::string out;
+    gzFile f = gzopen( name.c_str(), "rb" );
+    DMX_CHECK( f != NULL );
+    if ( f == NULL ) {
+      return out;
+    }
+    char buffer[ 1 << 16 ];
+    int n;
+    while ( ( n = gzread( f, buffer, sizeof( buffer ) ) ) > 0 ) {
+      out.append( buffer, n );
+    }
+    DMX_CHECK( n == 0 );
+    gzclose( f );
+    return out;
+  }
+
+  std::string readInflater( const std::string & name, size_t batchBlocks ) {
+    std::string out;
+    dmxInflater inflater( name.c_str(), batchBlocks );
+    DMX_CHECK( inflater.format() == dmxInflater::BGZF );
+    dmxBlock block;
+    while ( inflater.next( block ) ) {
+      out.append( block.data.begin(), block.data.end() );
+    }
+    return out;
+  }
+
+#ifdef DMX_HAVE_ZSTD
+  std::string readZstd( const std::string & name ) {
+    std::string in = readFile( name );
+    std::string out;
+    ZSTD_DStream * stream = ZSTD_createDStream();
+    ZSTD_initDStream( stream );
+    ZSTD_inBuffer input = { in.data(), in.size(), 0 };
+    std::vector< char > buffer( ZSTD_DStreamOutSize() );
+    while ( input.pos < input.size ) {
+      ZSTD_outBuffer output = { &buffer[ 0 ], buffer.size(), 0 };
+      size_t r = ZSTD_decompressStream( stream, &output, &input );
+      DMX_CHECK( !ZSTD_isError( r ) );
+      if ( ZSTD_isError( r ) ) {
+        break;
+      }
+      out.append( &buffer[ 0 ], output.pos );
+    }
+    ZSTD_freeDStream( stream );
+    return out;
+  }
+#endif
+}
+
+int main() {
+  std::vector< std::string > buffers = makeBuffers();
+  std::string expected;
+  for ( size_t i = 0; i < buffers.size(); ++i ) {
+    expected += buffers[ i ];
+  }
+
+  std::string plain = writeFile( dmxTestScratch( "plain" ), dmxWriter::NO_COMPRESSION, buffers );
+  DMX_CHECK_BYTES( expected, readFile( plain ) );
+  std::remove( plain.c_str() );
+
+  std::string bgzf = writeFile( dmxTestScratch( "bgzf.gz" ), dmxWriter::GZIP_COMPRESSION, buffers );
+  DMX_CHECK( dmxInflater::isGzip( bgzf.c_str() ) );
+  DMX_CHECK_BYTES( expected, readGzip( bgzf ) );
+  // one member per batch, and every member in one batch
+  DMX_CHECK_BYTES( expected, readInflater( bgzf, 1 ) );
+  DMX_CHECK_BYTES( expected, readInflater( bgzf, dmxInflater::defaultBatchBlocks ) );
+  std::remove( bgzf.c_str() );
+
+#ifdef DMX_HAVE_ZSTD
+  std::string zstd = writeFile( dmxTestScratch( "frames.zst" ), dmxWriter::ZSTD_COMPRESSION, buffers );
+  DMX_CHECK_BYTES( expected, readZstd( zstd ) );
+  std::remove( zstd.c_str() );
+#endif
+
+  return dmxTestResult( "dmxWriterTest" );
+}